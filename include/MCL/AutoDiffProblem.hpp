@@ -0,0 +1,114 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_AUTODIFFPROBLEM_H
+#define MCL_AUTODIFFPROBLEM_H
+
+#include "Problem.hpp"
+#include <unsupported/Eigen/AutoDiff>
+
+namespace mcl {
+namespace optlib {
+
+//
+// Forward-mode automatic differentiation (Eigen::AutoDiffScalar) for small,
+// fixed size problems. The energy is written once as a template:
+//
+//	class MyProblem : public AutoDiffProblem<MyProblem,double,2> {
+//		bool converged(const VecX &x0, const VecX &x1, const VecX &grad);
+//		template<typename T> T energy(const Eigen::Matrix<T,2,1> &x);
+//	};
+//
+// and the value, gradient, hessian, and hessian-vector products are exact.
+// The derivatives are fixed size, so the cost of a gradient is about one
+// evaluation with DIM-wide vector arithmetic and nothing is allocated.
+// The hessian nests two AutoDiffScalars and costs DIM times more.
+// Use std:: math functions unqualified (using std::sin; sin(x)) so that
+// the AutoDiffScalar overloads are found.
+//
+template<typename Derived, typename Scalar, int DIM>
+class AutoDiffProblem : public Problem<Scalar,DIM> {
+public:
+	static_assert( DIM != Eigen::Dynamic, "AutoDiffProblem requires a fixed DIM" );
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+
+	// First derivatives
+	typedef Eigen::AutoDiffScalar<VecX> ADScalar;
+	typedef Eigen::Matrix<ADScalar,DIM,1> ADVecX;
+
+	// Second derivatives (derivatives of ADScalar)
+	typedef Eigen::AutoDiffScalar< Eigen::Matrix<ADScalar,DIM,1> > AD2Scalar;
+	typedef Eigen::Matrix<AD2Scalar,DIM,1> AD2VecX;
+
+	// Directional second derivatives, for hessian_vec
+	typedef Eigen::AutoDiffScalar< Eigen::Matrix<ADScalar,1,1> > ADDirScalar;
+	typedef Eigen::Matrix<ADDirScalar,DIM,1> ADDirVecX;
+
+	virtual ~AutoDiffProblem(){}
+
+	// Calls Derived::energy with Scalar
+	virtual Scalar value(const VecX &x){
+		return derived().energy(x);
+	}
+
+	// Compute the objective value and the exact gradient
+	virtual Scalar gradient(const VecX &x, VecX &grad){
+		ADVecX xad;
+		for( int i=0; i<DIM; ++i ){ xad[i] = ADScalar(x[i], DIM, i); }
+		ADScalar f = derived().energy(xad);
+		grad = f.derivatives();
+		return f.value();
+	}
+
+	// Compute the exact hessian
+	virtual void hessian(const VecX &x, MatX &hess){
+		AD2VecX xad;
+		for( int i=0; i<DIM; ++i ){
+			xad[i].value() = ADScalar(x[i], DIM, i);
+			xad[i].derivatives().setZero();
+			xad[i].derivatives()[i] = ADScalar(1);
+		}
+		AD2Scalar f = derived().energy(xad);
+		for( int i=0; i<DIM; ++i ){ hess.row(i) = f.derivatives()[i].derivatives().transpose(); }
+	}
+
+	// Compute Hv = H(x)*v exactly, as the derivative of the gradient along v
+	virtual void hessian_vec(const VecX &x, const VecX &v, VecX &Hv){
+		ADDirVecX xad;
+		for( int i=0; i<DIM; ++i ){
+			xad[i].value() = ADScalar(x[i], DIM, i);
+			xad[i].derivatives()[0] = ADScalar(v[i]);
+		}
+		ADDirScalar f = derived().energy(xad);
+		Hv = f.derivatives()[0].derivatives();
+	}
+
+protected:
+	inline Derived &derived(){ return *static_cast<Derived*>(this); }
+
+}; // end class AutoDiffProblem
+
+} // ns optlib
+} // ns mcl
+
+#endif
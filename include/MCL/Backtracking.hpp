@@ -23,6 +23,7 @@
 #define MCL_BACKTRACKING_H
 
 #include "Problem.hpp"
+#include "LineSearchState.hpp"
 
 namespace mcl {
 namespace optlib {
@@ -36,32 +37,49 @@ class Backtracking {
 public:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 
-	static inline Scalar search(int verbose, int max_iters, Scalar decrease, const VecX &x, const VecX &p, Problem<Scalar,DIM> &problem, Scalar alpha0) {
+	// fx and grad are f(x) and its gradient on input, and f(x+alpha*p)
+	// and its gradient at the returned alpha on output.
+	// x_trial and grad_trial are preallocated buffers (same size as x)
+	// iters = number of trial steps on output
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		(void)(grad_trial);
+		iters = 0;
+		const int verbose = settings.verbose;
+		const int max_iters = settings.ls_max_iters;
+		const Scalar decrease = settings.ls_decrease;
 
 		// First things first, check descent norm
 		const Scalar t_eps = std::numeric_limits<Scalar>::epsilon();
-		if( p.norm() <= t_eps ){ return decrease; }
+		if( p.norm() <= t_eps ){
+			x_trial = x + decrease*p;
+			fx = problem.gradient(x_trial, grad);
+			return decrease;
+		}
 
 		const Scalar tau = 0.7;
 		Scalar alpha = alpha0;
-		VecX grad;
-		if( DIM == Eigen::Dynamic ){ grad = VecX::Zero(x.rows()); }
-		Scalar fx0 = problem.gradient(x, grad);
+		Scalar fx0 = fx;
 		Scalar gtp = grad.dot(p);
 
 		int iter = 0;
 		for( ; iter < max_iters; ++iter ){
-			Scalar fxa = problem.value(x + alpha*p);
+			if( state.deadline.expired() ){ iters = iter; return -1; } // out of time
+			x_trial = x + alpha*p;
+			Scalar fxa = problem.value(x_trial);
 			Scalar fx0_fxa = fx0 + alpha*decrease*gtp; // Armijo condition I
 			if( fxa <= fx0_fxa ){ break; } // sufficient decrease
 			alpha *= tau;
 		}
+		iters = std::min( iter+1, max_iters );
 
 		if( iter >= max_iters ){
 			if( verbose > 0 ){ printf("Backtracking::search Error: Reached max_iters\n"); }
 			return -1;
 		}
 
+		fx = problem.gradient(x_trial, grad);
 		return alpha;
 	}
 
@@ -76,45 +94,79 @@ class BacktrackingCubic {
 public:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 
-	static inline Scalar search(int verbose, int max_iters, Scalar decrease, const VecX &x, const VecX &p, Problem<Scalar,DIM> &problem, Scalar alpha0) {
+	// fx and grad are f(x) and its gradient on input, and f(x+alpha*p)
+	// and its gradient at the returned alpha on output.
+	// x_trial and grad_trial are preallocated buffers (same size as x)
+	// iters = number of trial steps on output
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		return search_ref(settings, state, x, p, problem, alpha0, fx, fx, grad, x_trial, grad_trial, iters);
+	}
+
+	// Same as search, with sufficient decrease measured from fx_ref >= fx
+	// instead of fx (see NonmonotoneBacktracking). The interpolation still uses fx.
+	template<typename P>
+	static inline Scalar search_ref(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar fx_ref, Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		(void)(grad_trial);
+		iters = 0;
+		const int verbose = settings.verbose;
+		const int max_iters = settings.ls_max_iters;
+		const Scalar decrease = settings.ls_decrease;
 
 		// First things first, check descent norm
 		const Scalar t_eps = std::numeric_limits<Scalar>::epsilon();
-		if( p.norm() <= t_eps ){ return decrease; }
+		if( p.norm() <= t_eps ){
+			x_trial = x + decrease*p;
+			fx = problem.gradient(x_trial, grad);
+			return decrease;
+		}
 
 		Scalar alpha = alpha0;
-		VecX grad;
-		if( DIM == Eigen::Dynamic ){ grad = VecX::Zero(x.rows()); }
-		Scalar fx0 = problem.gradient(x, grad);
+		Scalar fx0 = fx;
 		Scalar gtp = grad.dot(p);
 		Scalar fxp = fx0;
 		Scalar alphap = alpha;
+		bool have_prev = false; // fxp and alphap are a finite trial step
 
 		int iter = 0;
 		for( ; iter < max_iters; ++iter ){
-			Scalar fxa = problem.value(x + alpha*p);
-			Scalar fx0_fxa = fx0 + alpha*decrease*gtp; // Armijo condition I
+			if( state.deadline.expired() ){ iters = iter; return -1; } // out of time
+			x_trial = x + alpha*p;
+			Scalar fxa = problem.value(x_trial);
+			Scalar fx0_fxa = fx_ref + alpha*decrease*gtp; // Armijo condition I
 			if( fxa <= fx0_fxa ){ break; } // sufficient decrease
 
-			Scalar alpha_tmp = iter == 0 ?
-				( gtp / (2.0 * (fx0 + gtp - fxa)) ) :
+			// Outside the domain of f, nothing to interpolate
+			if( !std::isfinite(fxa) ){
+				alpha *= Scalar(0.5);
+				continue;
+			}
+
+			Scalar alpha_tmp = !have_prev ?
+				( gtp / (Scalar(2) * (fx0 + gtp - fxa)) ) :
 				cubic( fx0, gtp, fxa, alpha, fxp, alphap );
 			fxp = fxa;
 			alphap = alpha;
-			alpha = range( alpha_tmp, 0.1*alpha, 0.5*alpha );
+			have_prev = true;
+			alpha = range( alpha_tmp, Scalar(0.1)*alpha, Scalar(0.5)*alpha );
 		}
+		iters = std::min( iter+1, max_iters );
 
 		if( iter >= max_iters ){
 			if( verbose > 0 ){ printf("BacktrackingCubic::search Error: Reached max_iters\n"); }
 			return -1;
 		}
 
+		fx = problem.gradient(x_trial, grad);
 		return alpha;
 	}
 
 private:
 	static inline Scalar range( Scalar alpha, Scalar low, Scalar high ){
-		if( alpha < low ){ return low; }
+		if( !std::isfinite(alpha) ){ return high; }
+		else if( alpha < low ){ return low; }
 		else if( alpha > high ){ return high; }
 		return alpha;
 	}
@@ -130,20 +182,90 @@ private:
 		typedef Eigen::Matrix<Scalar,2,1> Vec2;
 		typedef Eigen::Matrix<Scalar,2,2> Mat2;
 
-		Scalar mult = 1.0 / ( alpha*alpha * alphap*alphap * (alpha-alphap) );
+		Scalar mult = Scalar(1) / ( alpha*alpha * alphap*alphap * (alpha-alphap) );
 		Mat2 A;
 		A(0,0) = alphap*alphap;		A(0,1) = -alpha*alpha;
 		A(1,0) = -alphap*alphap*alphap;	A(1,1) = alpha*alpha*alpha;	
 		Vec2 B;
 		B[0] = fxa - fx0 - alpha*gtp; B[1] = fxp - fx0 - alphap*gtp;
 		Vec2 r = mult * A * B;
-		if( std::abs(r[0]) <= 0.0 ){ return -gtp / (2.0*r[1]); } // if quadratic
-		Scalar d = std::sqrt( r[1]*r[1] - 3.0*r[0]*gtp ); // discrim
-		return (-r[1] + d) / (3.0*r[0]);
+		if( std::abs(r[0]) <= Scalar(0) ){ return -gtp / (Scalar(2)*r[1]); } // if quadratic
+		Scalar d = std::sqrt( r[1]*r[1] - Scalar(3)*r[0]*gtp ); // discrim
+		return (-r[1] + d) / (Scalar(3)*r[0]);
 	}
 
 }; // end class BacktrackingCubic
 
+
+//
+// BacktrackingCubic against a nonmonotone reference (see NonmonotoneSettings).
+// Every call adds f(x) to the history in state, so it must be called once per
+// iterate, and the solver resets the history (LineSearchState::begin_solve).
+//
+template<typename Scalar, int DIM>
+class NonmonotoneBacktracking {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	// Same as Backtracking::search
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		const Scalar fx_ref = std::max( fx, state.nonmonotone_reference(settings.nm, fx) );
+		return BacktrackingCubic<Scalar,DIM>::search_ref(settings, state, x, p, problem, alpha0, fx_ref, fx, grad, x_trial, grad_trial, iters);
+	}
+
+}; // end class NonmonotoneBacktracking
+
+
+//
+// Backtracking Armijo along the projection onto the box lower <= x <= upper,
+// i.e. trial points P(x + alpha*p). Sufficient decrease is measured along the
+// projected step. Takes the bounds, so it is called directly by LBFGSB
+// rather than used as a line search policy.
+//
+template<typename Scalar, int DIM>
+class ProjectedBacktracking {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	// Same as Backtracking::search, except that x_trial is the
+	// accepted (projected) point on output.
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p,
+		const VecX &lower, const VecX &upper, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		(void)(grad_trial);
+		iters = 0;
+		const int verbose = settings.verbose;
+		const int max_iters = settings.ls_max_iters;
+		const Scalar decrease = settings.ls_decrease;
+		const Scalar tau = 0.7;
+		Scalar alpha = alpha0;
+		Scalar fx0 = fx;
+
+		int iter = 0;
+		for( ; iter < max_iters; ++iter ){
+			if( state.deadline.expired() ){ iters = iter; return -1; } // out of time
+			x_trial = (x + alpha*p).cwiseMax(lower).cwiseMin(upper);
+			Scalar fxa = problem.value(x_trial);
+			Scalar fx0_fxa = fx0 + decrease*grad.dot(x_trial - x); // Armijo condition I
+			if( fxa <= fx0_fxa ){ break; } // sufficient decrease
+			alpha *= tau;
+		}
+		iters = std::min( iter+1, max_iters );
+
+		if( iter >= max_iters ){
+			if( verbose > 0 ){ printf("ProjectedBacktracking::search Error: Reached max_iters\n"); }
+			return -1;
+		}
+
+		fx = problem.gradient(x_trial, grad);
+		return alpha;
+	}
+
+}; // end class ProjectedBacktracking
+
 } // ns optlib
 } // ns mcl
 
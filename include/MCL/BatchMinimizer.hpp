@@ -0,0 +1,248 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_BATCHMINIMIZER_H
+#define MCL_BATCHMINIMIZER_H
+
+#include "BatchProblem.hpp"
+#include "SolveReport.hpp"
+#include "ThreadPool.hpp"
+#include <memory>
+#include <vector>
+
+namespace mcl {
+namespace optlib {
+
+// Step used by BatchMinimizer
+enum class BatchMethod {
+	Newton, // uses BatchProblem::solve_hessian
+	LBFGS
+};
+
+//
+// Minimizes many small problems of compile-time DIM. Problems are packed LANES
+// at a time into structure-of-arrays batches (see BatchProblem.hpp) and stepped
+// in lock-step, so every evaluation and vector operation covers all lanes.
+// Lanes that converge (or fail) are masked out and keep their result while
+// the rest of the batch continues. Batches are spread over a thread pool
+// if Settings::threads != 1, which requires the problem to be thread safe.
+// Steps use backtracking (Armijo) with a single trial step for all lanes.
+//
+template<typename Scalar, int DIM, int LANES=8, int M=4>
+class BatchMinimizer {
+public:
+	typedef BatchProblem<Scalar,DIM,LANES> BProblem;
+	typedef typename BProblem::BatchX BatchX;
+	typedef typename BProblem::BatchS BatchS;
+	typedef typename BProblem::BatchI BatchI;
+	typedef typename BProblem::BatchB BatchB;
+	typedef Eigen::Matrix<Scalar,DIM,Eigen::Dynamic> MatXN; // x of each problem as a column
+
+	struct Settings {
+		int verbose; // higher = more printouts
+		int max_iters; // max iterations per problem
+		int ls_max_iters; // max line search iters
+		Scalar ls_decrease; // sufficient decrease param
+		BatchMethod method; // see BatchMethod (above)
+		int threads; // 1 = serial, 0 = hardware concurrency
+
+		Settings() : verbose(0), max_iters(100),
+			ls_max_iters(50), ls_decrease(1e-4),
+			method(BatchMethod::LBFGS), threads(1)
+			{}
+	} m_settings;
+
+	// Results of the last call to minimize, for each problem
+	Eigen::VectorXi m_iters;
+	std::vector<Termination> m_termination;
+
+	// Minimizes every column of X (one problem per column), with problem
+	// index i solved from the initial guess X.col(i). Returns the number
+	// of problems that converged.
+	int minimize(BProblem &problem, MatXN &X){
+		const int n = X.cols();
+		m_iters = Eigen::VectorXi::Zero(n);
+		m_termination.assign(n, Termination::None);
+		if( n == 0 ){ return 0; }
+
+		const int n_batches = (n + LANES - 1) / LANES;
+		const int threads = m_settings.threads;
+		if( threads != 1 && ( !m_pool || (threads > 0 && m_pool->size() != threads) ) ){
+			m_pool.reset( new ThreadPool(threads) );
+		}
+		const int n_threads = threads != 1 ? m_pool->size() : 1;
+		if( int(m_ws.size()) < n_threads ){ m_ws.resize(n_threads); }
+
+		auto solve = [&](int batch, int thread){ solve_batch(problem, X, batch*LANES, m_ws[thread]); };
+		if( n_threads > 1 ){ m_pool->parallel_for(n_batches, solve); }
+		else { for( int b=0; b<n_batches; ++b ){ solve(b,0); } }
+
+		int n_converged = 0;
+		for( int i=0; i<n; ++i ){ n_converged += m_termination[i] == Termination::Converged; }
+		return n_converged;
+	}
+
+private:
+	// Buffers for one batch, one per thread
+	struct Workspace {
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		BatchX x, x_old, x_trial, grad, grad_old, p, q;
+		BatchS fx, f_trial, gtp, alpha, gamma;
+		BatchI index, iters, term;
+		BatchB active, done, ok;
+		BatchX s[M], y[M]; // L-BFGS history, ring buffer shared by the lanes
+		BatchS rho[M], a[M]; // rho = 0 for pairs a lane skipped
+		int head, n_hist;
+	};
+
+	std::vector<Workspace, Eigen::aligned_allocator<Workspace> > m_ws;
+	std::unique_ptr<ThreadPool> m_pool;
+
+	// Applies a per-lane mask to every coordinate: x = mask ? a : x
+	static inline void select(const BatchB &mask, const BatchX &a, BatchX &x){
+		for( int d=0; d<DIM; ++d ){ x.col(d) = mask.select(a.col(d), x.col(d)); }
+	}
+
+	// Row-wise dot product
+	static inline BatchS dot(const BatchX &a, const BatchX &b){
+		return (a*b).rowwise().sum();
+	}
+
+	void solve_batch(BProblem &problem, MatXN &X, int first, Workspace &ws){
+		const int n = X.cols();
+		const int count = std::min(LANES, n-first);
+		const Scalar eps = std::numeric_limits<Scalar>::epsilon();
+		const Scalar tau = 0.5;
+		const bool lbfgs = m_settings.method == BatchMethod::LBFGS;
+
+		for( int l=0; l<LANES; ++l ){
+			ws.index(l) = first + std::min(l, count-1);
+			ws.x.row(l) = X.col(ws.index(l)).transpose();
+			ws.active(l) = l < count;
+		}
+		ws.iters.setZero();
+		ws.term.setConstant( int(Termination::MaxIters) );
+		ws.gamma.setOnes();
+		ws.head = 0;
+		ws.n_hist = 0;
+
+		problem.gradient(ws.index, ws.x, ws.grad, ws.fx);
+
+		for( int iter=0; iter < m_settings.max_iters && ws.active.any(); ++iter ){
+
+			// Descent direction
+			if( lbfgs ){ lbfgs_direction(ws); }
+			else { problem.solve_hessian(ws.index, ws.x, ws.grad, ws.p); }
+
+			// Use gradient descent in lanes without descent
+			ws.gtp = dot(ws.grad, ws.p);
+			ws.done = ws.gtp >= 0;
+			ws.alpha.setOnes();
+			if( ws.done.any() ){
+				select(ws.done, -ws.grad, ws.p);
+				ws.gtp = ws.done.select( -dot(ws.grad, ws.grad), ws.gtp );
+				BatchS g_inf = ws.grad.abs().rowwise().maxCoeff();
+				ws.alpha = ws.done.select( (Scalar(1)/g_inf).min(Scalar(1)), ws.alpha );
+				if( lbfgs ){ // drop the history of those lanes
+					for( int i=0; i<M; ++i ){ ws.rho[i] = ws.done.select( Scalar(0), ws.rho[i] ); }
+					ws.gamma = ws.done.select( Scalar(1), ws.gamma );
+				}
+			}
+
+			// Backtracking, lanes that pass keep their alpha
+			ws.ok = !ws.active;
+			for( int ls=0; ls < m_settings.ls_max_iters; ++ls ){
+				for( int d=0; d<DIM; ++d ){ ws.x_trial.col(d) = ws.x.col(d) + ws.alpha*ws.p.col(d); }
+				problem.value(ws.index, ws.x_trial, ws.f_trial);
+				ws.ok = ws.ok || ( ws.f_trial <= ws.fx + m_settings.ls_decrease*ws.alpha*ws.gtp );
+				if( ws.ok.all() ){ break; }
+				ws.alpha = ws.ok.select( ws.alpha, tau*ws.alpha );
+			}
+			ws.done = ws.active && !ws.ok;
+			if( ws.done.any() ){
+				if( m_settings.verbose > 0 ){ printf("BatchMinimizer::minimize: Failure in linesearch\n"); }
+				ws.term = ws.done.select( int(Termination::LineSearchFailure), ws.term );
+				ws.active = ws.active && ws.ok;
+			}
+
+			// Step the active lanes
+			ws.x_old = ws.x;
+			ws.grad_old = ws.grad;
+			select(ws.active, ws.x_trial, ws.x);
+			problem.gradient(ws.index, ws.x, ws.grad, ws.fx);
+			ws.iters += ws.active.template cast<int>();
+
+			ws.done = ws.active && !(ws.fx == ws.fx); // NaN
+			if( ws.done.any() ){
+				ws.term = ws.done.select( int(Termination::NaN), ws.term );
+				ws.active = ws.active && !ws.done;
+			}
+
+			problem.converged(ws.index, ws.x_old, ws.x, ws.grad, ws.done);
+			ws.done = ws.done && ws.active;
+			ws.term = ws.done.select( int(Termination::Converged), ws.term );
+			ws.active = ws.active && !ws.done;
+
+			if( lbfgs ){
+				const int h = ws.head;
+				ws.s[h] = ws.x - ws.x_old;
+				ws.y[h] = ws.grad - ws.grad_old;
+				BatchS sy = dot(ws.s[h], ws.y[h]);
+				BatchS yy = dot(ws.y[h], ws.y[h]);
+				ws.done = ws.active && (sy > eps*yy); // curvature condition
+				ws.rho[h] = ws.done.select( Scalar(1)/sy, Scalar(0) );
+				ws.gamma = ws.done.select( sy/yy, ws.gamma );
+				ws.head = (h + 1) % M;
+				ws.n_hist = std::min(ws.n_hist + 1, M);
+			}
+		}
+
+		for( int l=0; l<count; ++l ){
+			X.col(first+l) = ws.x.row(l).transpose();
+			m_iters[first+l] = ws.iters(l);
+			m_termination[first+l] = Termination(ws.term(l));
+		}
+	}
+
+	// L-BFGS two-loop recursion for all lanes, p = -H grad
+	static inline void lbfgs_direction(Workspace &ws){
+		ws.q = ws.grad;
+		for( int j=0; j<ws.n_hist; ++j ){
+			int i = (ws.head - 1 - j + M) % M;
+			ws.a[i] = ws.rho[i]*dot(ws.s[i], ws.q);
+			for( int d=0; d<DIM; ++d ){ ws.q.col(d) -= ws.a[i]*ws.y[i].col(d); }
+		}
+		for( int d=0; d<DIM; ++d ){ ws.q.col(d) *= ws.gamma; }
+		for( int j=ws.n_hist-1; j>=0; --j ){
+			int i = (ws.head - 1 - j + M) % M;
+			BatchS beta = ws.rho[i]*dot(ws.y[i], ws.q);
+			for( int d=0; d<DIM; ++d ){ ws.q.col(d) += (ws.a[i]-beta)*ws.s[i].col(d); }
+		}
+		ws.p = -ws.q;
+	}
+
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
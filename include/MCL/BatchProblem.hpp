@@ -0,0 +1,109 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_BATCHPROBLEM_H
+#define MCL_BATCHPROBLEM_H
+
+#include "Problem.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Many small problems of the same DIM, evaluated LANES at a time (see BatchMinimizer.hpp).
+// Variables are stored as structure-of-arrays: row l of a BatchX is the x of lane l,
+// so each column (one coordinate across all lanes) is contiguous and vectorizes.
+// index(l) is the problem solved by lane l. Lanes past the last problem repeat
+// the last index and their results are ignored.
+//
+template<typename Scalar, int DIM, int LANES>
+class BatchProblem {
+public:
+	typedef Eigen::Array<Scalar,LANES,DIM> BatchX;
+	typedef Eigen::Array<Scalar,LANES,1> BatchS;
+	typedef Eigen::Array<int,LANES,1> BatchI;
+	typedef Eigen::Array<bool,LANES,1> BatchB;
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+
+	virtual ~BatchProblem(){}
+
+	// Sets done(l) = true if lane l has converged
+	// x0 is the result of the previous iteration
+	// x1 is the result at the current iteration
+	// grad is the gradient at the last iteration
+	virtual void converged(const BatchI &index, const BatchX &x0, const BatchX &x1, const BatchX &grad, BatchB &done) = 0;
+
+	// Compute just the values
+	virtual void value(const BatchI &index, const BatchX &x, BatchS &fx) = 0;
+
+	// Compute the values and the gradients
+	virtual void gradient(const BatchI &index, const BatchX &x, BatchX &grad, BatchS &fx){
+		finiteGradient(index, x, grad);
+		value(index, x, fx);
+	}
+
+	// Solve dx = H^-1 -g for every lane (used by BatchMethod::Newton).
+	// Default uses finite differences of the gradient, DIM at a time.
+	virtual void solve_hessian(const BatchI &index, const BatchX &x, const BatchX &grad, BatchX &dx){
+		const Scalar eps = std::max( Scalar(1e-5), std::cbrt(std::numeric_limits<Scalar>::epsilon()) );
+		BatchX xx = x, grad_p, grad_m, hess_col[DIM];
+		BatchS fx;
+		for( int d=0; d<DIM; ++d ){
+			xx.col(d) = x.col(d) + eps;
+			gradient(index, xx, grad_p, fx);
+			xx.col(d) = x.col(d) - eps;
+			gradient(index, xx, grad_m, fx);
+			xx.col(d) = x.col(d);
+			hess_col[d] = (grad_p - grad_m) / (Scalar(2)*eps);
+		}
+		MatX hess;
+		VecX g, dx_l;
+		for( int l=0; l<LANES; ++l ){
+			for( int d=0; d<DIM; ++d ){ hess.col(d) = hess_col[d].row(l).transpose(); }
+			hess = Scalar(0.5)*(hess + hess.transpose()).eval();
+			g = grad.row(l).transpose();
+			Problem<Scalar,DIM>::solve_dense(hess, g, dx_l);
+			dx.row(l) = dx_l.transpose();
+		}
+	}
+
+	// Gradient with central finite differences, one coordinate of all lanes at a time
+	inline void finiteGradient(const BatchI &index, const BatchX &x, BatchX &grad){
+		const Scalar eps = std::max( Scalar(2.2204e-6), std::sqrt(std::numeric_limits<Scalar>::epsilon()) );
+		BatchX xx = x;
+		BatchS fp, fm;
+		for( int d=0; d<DIM; ++d ){
+			xx.col(d) = x.col(d) + eps;
+			value(index, xx, fp);
+			xx.col(d) = x.col(d) - eps;
+			value(index, xx, fm);
+			xx.col(d) = x.col(d);
+			grad.col(d) = (fp - fm) / (Scalar(2)*eps);
+		}
+	}
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
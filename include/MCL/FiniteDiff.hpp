@@ -0,0 +1,328 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_FINITEDIFF_H
+#define MCL_FINITEDIFF_H
+
+#include "ThreadPool.hpp"
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include <memory>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace mcl {
+namespace optlib {
+
+//
+// Finite difference gradients of a scalar function, used by Problem
+// when an analytic gradient is not given. Every coordinate is perturbed
+// in place (and restored) in a single copy of x, so a gradient does not
+// allocate after the first call. If the function is thread safe, the
+// coordinates are split among a thread pool.
+//
+// Hessians are computed from central differences of the gradient and
+// symmetrized. Given a sparsity pattern (see color), columns that share
+// no row are perturbed together (Curtis-Powell-Reid), so a sparse hessian
+// costs two gradients per color instead of two per column. If the gradient
+// is itself a finite difference, hessian_value uses second differences of
+// the value instead, which only evaluates the upper triangle.
+//
+template<typename Scalar, int DIM>
+class FiniteDiff {
+private:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+	typedef Eigen::SparseMatrix<Scalar> SparseMat;
+
+public:
+	struct Settings {
+		int accuracy; // stencil order: 0 = 2 point, 1 = 4, 2 = 6, 3 = 8 point
+		Scalar eps; // step size, at least sqrt(machine eps)
+		Scalar hess_eps; // step size for hessians, at least cbrt(machine eps)
+		Scalar hess_value_eps; // step size for hessian_value, at least (machine eps)^1/4
+		bool thread_safe; // set to true if value(x) can be called concurrently
+		int threads; // threads used if thread_safe, 0 = hardware concurrency
+
+		Settings() : accuracy(0),
+			eps( std::max( Scalar(2.2204e-6), std::sqrt(std::numeric_limits<Scalar>::epsilon()) ) ),
+			hess_eps( std::max( Scalar(1e-5), std::cbrt(std::numeric_limits<Scalar>::epsilon()) ) ),
+			hess_value_eps( std::max( Scalar(1e-4), std::sqrt(std::sqrt(std::numeric_limits<Scalar>::epsilon())) ) ),
+			thread_safe(false), threads(0)
+			{}
+	} m_settings;
+
+	FiniteDiff(){}
+
+	// Copies the settings and coloring, buffers and threads are not shared
+	FiniteDiff(const FiniteDiff &other) : m_settings(other.m_settings), m_coloring(other.m_coloring) {}
+	FiniteDiff& operator=(const FiniteDiff &other){
+		m_settings = other.m_settings;
+		m_coloring = other.m_coloring;
+		return *this;
+	}
+
+	// Central difference stencils: f'(x) = 1/(denom*eps) * sum_s coeff[s]*f(x + offset[s]*eps).
+	// Only the first 2*(accuracy+1) entries of each row are used.
+	static inline Scalar coeff(int accuracy, int s){
+		static const Scalar c[4][8] = {
+			{1, -1}, {1, -8, 8, -1}, {-1, 9, -45, 45, -9, 1}, {3, -32, 168, -672, 672, -168, 32, -3} };
+		return c[accuracy][s];
+	}
+	static inline Scalar offset(int accuracy, int s){
+		static const Scalar o[4][8] = {
+			{1, -1}, {-2, -1, 1, 2}, {-3, -2, -1, 1, 2, 3}, {-4, -3, -2, -1, 1, 2, 3, 4} };
+		return o[accuracy][s];
+	}
+	static inline Scalar denom(int accuracy){
+		static const Scalar d[4] = {2, 12, 60, 840};
+		return d[accuracy];
+	}
+
+	// Computes grad of value(x), where value is any callable
+	// taking a const VecX& and returning a Scalar.
+	template<typename F>
+	void gradient(const F &value, const VecX &x, VecX &grad){
+		const int dim = x.rows();
+		const int accuracy = std::max( 0, std::min( 3, m_settings.accuracy ) );
+		if( grad.rows() != dim ){ grad = VecX::Zero(dim); }
+
+		const int n_threads = m_settings.thread_safe ? pool().size() : 1;
+		if( int(m_x.size()) < n_threads ){ m_x.resize(n_threads); }
+		for( int t=0; t<n_threads; ++t ){ m_x[t] = x; }
+
+		auto partial = [&](int d, int thread){
+			VecX &xx = m_x[thread];
+			const Scalar xd = xx[d];
+			Scalar gd = 0;
+			for( int s=0; s<2*(accuracy+1); ++s ){
+				xx[d] = xd + offset(accuracy,s)*m_settings.eps;
+				gd += coeff(accuracy,s)*value(xx);
+			}
+			xx[d] = xd;
+			grad[d] = gd / (denom(accuracy)*m_settings.eps);
+		};
+
+		if( n_threads > 1 ){ pool().parallel_for(dim, partial); }
+		else { for( int d=0; d<dim; ++d ){ partial(d,0); } }
+	}
+
+	// Computes the hessian from the gradient, where gradient is any callable
+	// taking (const VecX&, VecX&) that sets the gradient. Costs 2n gradients.
+	template<typename G>
+	void hessian(const G &gradient, const VecX &x, MatX &hess){
+		const int dim = x.rows();
+		const Scalar h = m_settings.hess_eps;
+		if( hess.rows() != dim || hess.cols() != dim ){ hess = MatX::Zero(dim,dim); }
+		resize_hess(x);
+		for( int j=0; j<dim; ++j ){
+			m_xh[j] = x[j] + h;
+			gradient(m_xh, m_gp);
+			m_xh[j] = x[j] - h;
+			gradient(m_xh, m_gm);
+			m_xh[j] = x[j];
+			hess.col(j) = (m_gp - m_gm) / (Scalar(2)*h);
+		}
+		for( int j=0; j<dim; ++j ){
+			for( int i=j+1; i<dim; ++i ){
+				Scalar hij = Scalar(0.5)*(hess(i,j) + hess(j,i));
+				hess(i,j) = hij;
+				hess(j,i) = hij;
+			}
+		}
+	}
+
+	// Computes the hessian from second differences of value(x), where value is any
+	// callable taking a const VecX& and returning a Scalar. Costs 2n^2+1 values,
+	// instead of 4n^2 for hessian with a finite difference gradient.
+	template<typename F>
+	void hessian_value(const F &value, const VecX &x, MatX &hess){
+		const int dim = x.rows();
+		const Scalar h = m_settings.hess_value_eps;
+		const Scalar h2 = h*h;
+		if( hess.rows() != dim || hess.cols() != dim ){ hess = MatX::Zero(dim,dim); }
+		resize_hess(x);
+		const Scalar fx = value(m_xh);
+		for( int i=0; i<dim; ++i ){
+
+			// Diagonal, and f(x + h e_i +/- h e_j) for the upper triangle of row i
+			m_xh[i] = x[i] + h;
+			const Scalar fp = value(m_xh);
+			for( int j=i+1; j<dim; ++j ){
+				m_xh[j] = x[j] + h;
+				hess(i,j) = value(m_xh);
+				m_xh[j] = x[j] - h;
+				hess(i,j) -= value(m_xh);
+				m_xh[j] = x[j];
+			}
+
+			// Then f(x - h e_i -/+ h e_j)
+			m_xh[i] = x[i] - h;
+			const Scalar fm = value(m_xh);
+			for( int j=i+1; j<dim; ++j ){
+				m_xh[j] = x[j] - h;
+				hess(i,j) += value(m_xh);
+				m_xh[j] = x[j] + h;
+				hess(i,j) -= value(m_xh);
+				m_xh[j] = x[j];
+				hess(i,j) /= Scalar(4)*h2;
+				hess(j,i) = hess(i,j);
+			}
+			m_xh[i] = x[i];
+			hess(i,i) = (fp - Scalar(2)*fx + fm) / h2;
+		}
+	}
+
+	// Computes Hv = H(x)*v from central differences of the gradient along v.
+	// The step is scaled by |v| so it is hess_eps in the space of x.
+	template<typename G>
+	void hessian_vec(const G &gradient, const VecX &x, const VecX &v, VecX &Hv){
+		const Scalar v_norm = v.norm();
+		if( Hv.rows() != x.rows() ){ Hv = VecX::Zero(x.rows()); }
+		if( v_norm <= 0 ){ Hv.setZero(); return; }
+		const Scalar h = m_settings.hess_eps / v_norm;
+		resize_hess(x);
+		m_xh.noalias() += h*v;
+		gradient(m_xh, m_gp);
+		m_xh.noalias() = x - h*v;
+		gradient(m_xh, m_gm);
+		Hv = (m_gp - m_gm) / (Scalar(2)*h);
+	}
+
+	// Groups the columns of a sparsity pattern (with both triangles) so that
+	// no two columns of a group have a nonzero in the same row. Must be called
+	// before sparse_hessian, and again if the pattern changes.
+	void color(const SparseMat &pattern){
+		Coloring &c = m_coloring;
+		const int dim = pattern.cols();
+		c.color = std::vector<int>(dim,-1);
+		c.n_colors = 0;
+
+		// Greedy distance-2 coloring of the column intersection graph
+		SparseMat rows = pattern.transpose(); // column i of rows = row i of pattern
+		std::vector<int> used(dim,-1); // used[color] = j if a neighbor of j has that color
+		for( int j=0; j<dim; ++j ){
+			for( typename SparseMat::InnerIterator it(pattern,j); it; ++it ){
+				for( typename SparseMat::InnerIterator it2(rows,it.row()); it2; ++it2 ){
+					int k = it2.row();
+					if( c.color[k] >= 0 ){ used[c.color[k]] = j; }
+				}
+			}
+			int cj = 0;
+			while( used[cj] == j ){ cj++; }
+			c.color[j] = cj;
+			c.n_colors = std::max(c.n_colors, cj+1);
+		}
+
+		// Columns of each color
+		c.color_ptr = std::vector<int>(c.n_colors+1,0);
+		for( int j=0; j<dim; ++j ){ c.color_ptr[c.color[j]+1]++; }
+		for( int i=0; i<c.n_colors; ++i ){ c.color_ptr[i+1] += c.color_ptr[i]; }
+		c.color_cols = std::vector<int>(dim);
+		std::vector<int> next(c.color_ptr.begin(), c.color_ptr.end()-1);
+		for( int j=0; j<dim; ++j ){ c.color_cols[next[c.color[j]]++] = j; }
+	}
+
+	// Number of colors found by color(), a sparse hessian costs two gradients per color
+	int n_colors() const { return m_coloring.n_colors; }
+
+	// Computes the nonzeros of a sparse hessian. hess must be compressed and
+	// have the pattern given to color(). Entries of the pattern that are
+	// stored in both triangles are averaged to make hess symmetric.
+	template<typename G>
+	void sparse_hessian(const G &gradient, const VecX &x, SparseMat &hess){
+		const Coloring &c = m_coloring;
+		if( int(c.color.size()) != hess.cols() || !hess.isCompressed() ){
+			throw std::runtime_error("FiniteDiff::sparse_hessian Error: call color() with the hessian pattern first");
+		}
+		const Scalar h = m_settings.hess_eps;
+		resize_hess(x);
+		const int *outer = hess.outerIndexPtr();
+		const int *inner = hess.innerIndexPtr();
+		Scalar *vals = hess.valuePtr();
+
+		for( int ci=0; ci<c.n_colors; ++ci ){
+			const int begin = c.color_ptr[ci], end = c.color_ptr[ci+1];
+			for( int s=begin; s<end; ++s ){ m_xh[c.color_cols[s]] += h; }
+			gradient(m_xh, m_gp);
+			for( int s=begin; s<end; ++s ){ int j = c.color_cols[s]; m_xh[j] = x[j] - h; }
+			gradient(m_xh, m_gm);
+			for( int s=begin; s<end; ++s ){
+				int j = c.color_cols[s];
+				m_xh[j] = x[j];
+				for( int k=outer[j]; k<outer[j+1]; ++k ){
+					int i = inner[k];
+					vals[k] = (m_gp[i] - m_gm[i]) / (Scalar(2)*h);
+				}
+			}
+		}
+
+		// Symmetrize, the (j,i) entry is found by a binary search of column i
+		for( int j=0; j<hess.cols(); ++j ){
+			for( int k=outer[j]; k<outer[j+1]; ++k ){
+				int i = inner[k];
+				if( i <= j ){ continue; }
+				const int *ji = std::lower_bound( inner+outer[i], inner+outer[i+1], j );
+				if( ji == inner+outer[i+1] || *ji != j ){ continue; }
+				Scalar &hji = vals[ji-inner];
+				hji = Scalar(0.5)*(vals[k] + hji);
+				vals[k] = hji;
+			}
+		}
+	}
+
+private:
+	struct Coloring {
+		int n_colors;
+		std::vector<int> color; // color of each column
+		std::vector<int> color_ptr, color_cols; // columns of color i are color_cols[color_ptr[i]:color_ptr[i+1]]
+		Coloring() : n_colors(0) {}
+	} m_coloring;
+
+	VecX m_xh, m_gp, m_gm; // perturbed x and gradients for hessians
+
+	void resize_hess(const VecX &x){
+		m_xh = x;
+		if( m_gp.rows() != x.rows() ){
+			m_gp = VecX::Zero(x.rows());
+			m_gm = VecX::Zero(x.rows());
+		}
+	}
+
+	std::vector<VecX, Eigen::aligned_allocator<VecX> > m_x; // perturbed copies of x, one per thread
+	std::unique_ptr<ThreadPool> m_pool;
+
+	ThreadPool &pool(){
+		const int threads = m_settings.threads;
+		if( !m_pool || (threads > 0 && m_pool->size() != threads) ){
+			m_pool.reset( new ThreadPool(threads) );
+		}
+		return *m_pool;
+	}
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
@@ -0,0 +1,201 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_HAGERZHANG_H
+#define MCL_HAGERZHANG_H
+
+#include "Problem.hpp"
+#include "LineSearchState.hpp"
+#include <limits>
+
+namespace mcl {
+namespace optlib {
+
+//
+// Line search of CG_DESCENT: Hager & Zhang (2005), "A new conjugate gradient method
+// with guaranteed descent and an efficient line search", and (2006) "Algorithm 851".
+// Brackets the step, then shrinks the bracket with double secant steps (or bisection)
+// until the Wolfe or the approximate Wolfe conditions hold. The approximate conditions
+// only use the slope, so they can be met near the minimum where f(x+alpha p) and f(x)
+// differ by rounding. Constants are ls_decrease (delta), ls_curvature (sigma) and
+// MinimizerSettings::hz. The error in f is epsilon |f(x)| instead of the running average
+// of CG_DESCENT. Non-finite trial values are treated as too large.
+//
+template<typename Scalar, int DIM>
+class HagerZhang {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+private:
+	// A trial step a with phi(a) = f(x+a*p) and its slope phi'(a) = grad(x+a*p)^T p
+	struct Point { Scalar a, f, d; };
+
+	// Evaluates trial points and checks them for termination
+	template<typename P>
+	class Phi {
+	public:
+		const MinimizerSettings<Scalar> &settings;
+		const Deadline &deadline;
+		const VecX &x, &p;
+		P &problem;
+		VecX &x_trial, &grad_trial;
+		Point p0; // phi(0)
+		Point last; // the accepted point if done
+		Scalar f_max; // approximate Wolfe bound on phi
+		int iters;
+		bool done, failed; // accepted the last point, or gave up
+
+		Phi(const MinimizerSettings<Scalar> &settings_, const Deadline &deadline_, const VecX &x_, const VecX &p_, P &problem_,
+			VecX &x_trial_, VecX &grad_trial_, Scalar fx, Scalar gtp) :
+			settings(settings_), deadline(deadline_), x(x_), p(p_), problem(problem_), x_trial(x_trial_), grad_trial(grad_trial_),
+			iters(0), done(false), failed(false) {
+			p0.a = 0; p0.f = fx; p0.d = gtp;
+			f_max = fx + settings.hz.epsilon * std::abs(fx);
+		}
+
+		bool stop() const { return done || failed; }
+
+		Point operator()(Scalar a){
+			Point pt;
+			pt.a = a;
+			x_trial = x + a*p;
+			pt.f = problem.gradient(x_trial, grad_trial);
+			pt.d = grad_trial.dot(p);
+			if( !std::isfinite(pt.f) || !std::isfinite(pt.d) ){
+				pt.f = std::numeric_limits<Scalar>::infinity();
+				pt.d = std::numeric_limits<Scalar>::quiet_NaN();
+			}
+			iters++;
+			if( wolfe(pt) ){ done = true; last = pt; }
+			else if( iters >= settings.ls_max_iters || deadline.expired() ){ failed = true; }
+			return pt;
+		}
+
+		// Wolfe: sufficient decrease and curvature. Approximate Wolfe:
+		// (2 delta - 1) phi'(0) >= phi'(a) >= sigma phi'(0) and phi(a) <= f_max.
+		bool wolfe(const Point &pt) const {
+			const Scalar delta = settings.ls_decrease;
+			if( !(pt.d >= settings.ls_curvature * p0.d) ){ return false; }
+			if( pt.f - p0.f <= delta * pt.a * p0.d ){ return true; }
+			return pt.f <= f_max && pt.d <= (Scalar(2)*delta - Scalar(1)) * p0.d;
+		}
+	};
+
+	// Step where the secant of phi' through a and b is zero
+	static inline Scalar secant(const Point &a, const Point &b){
+		return ( a.a*b.d - b.a*a.d ) / ( b.d - a.d );
+	}
+
+	// Shrinks [a,b] with phi'(b) < 0 and phi(b) > f_max by bisection,
+	// until phi'(B) >= 0 (procedure U3). Returns false to stop the search.
+	template<typename P>
+	static inline bool update_bisect(Phi<P> &phi, const Point &a, const Point &b, Point &A, Point &B){
+		const Scalar theta = phi.settings.hz.theta;
+		A = a; B = b;
+		while( B.a - A.a > std::numeric_limits<Scalar>::epsilon() * B.a ){
+			Point d = phi( (Scalar(1)-theta)*A.a + theta*B.a );
+			if( phi.stop() ){ return false; }
+			if( d.d >= 0 ){ B = d; return true; }
+			if( d.f <= phi.f_max ){ A = d; }
+			else { B = d; }
+		}
+		phi.failed = true;
+		return false;
+	}
+
+	// New bracket [A,B] from [a,b] and a trial step c (procedure update).
+	// Returns false to stop the search.
+	template<typename P>
+	static inline bool update(Phi<P> &phi, const Point &a, const Point &b, Scalar c, Point &A, Point &B){
+		A = a; B = b;
+		if( !(c > a.a && c < b.a) ){ return true; }
+		Point pc = phi(c);
+		if( phi.stop() ){ return false; }
+		if( pc.d >= 0 ){ B = pc; return true; }
+		if( pc.f <= phi.f_max ){ A = pc; return true; }
+		return update_bisect(phi, a, pc, A, B);
+	}
+
+	// Double secant step (procedure secant2)
+	template<typename P>
+	static inline bool secant2(Phi<P> &phi, const Point &a, const Point &b, Point &A, Point &B){
+		Scalar c = secant(a, b);
+		if( !update(phi, a, b, c, A, B) ){ return false; }
+		if( c == B.a ){ Point A0 = A, B0 = B; return update(phi, A0, B0, secant(b, B0), A, B); }
+		if( c == A.a ){ Point A0 = A, B0 = B; return update(phi, A0, B0, secant(a, A0), A, B); }
+		return true;
+	}
+
+public:
+	// fx and grad are f(x) and its gradient on input, and f(x+alpha*p)
+	// and its gradient at the returned alpha on output.
+	// x_trial and grad_trial are preallocated buffers (same size as x)
+	// iters = number of trial steps on output
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		Phi<P> phi(settings, state.deadline, x, p, problem, x_trial, grad_trial, fx, grad.dot(p));
+		iters = 0;
+		if( !(phi.p0.d < 0) ){
+			if( settings.verbose > 0 ){ printf("HagerZhang::linesearch Error: not a descent direction\n"); }
+			return -1;
+		}
+
+		// Bracket: grow the step until the slope is positive or phi is too large
+		Point a = phi.p0, b;
+		Point c = phi(alpha0);
+		while( !phi.stop() ){
+			if( c.d >= 0 ){ b = c; break; }
+			if( !(c.f <= phi.f_max) ){ update_bisect(phi, phi.p0, c, a, b); break; }
+			a = c;
+			c = phi( settings.hz.rho * c.a );
+		}
+
+		// Shrink the bracket [a,b]
+		while( !phi.stop() ){
+			Point A, B;
+			if( !secant2(phi, a, b, A, B) ){ break; }
+			if( B.a - A.a > settings.hz.gamma * (b.a - a.a) ){
+				Point A0 = A, B0 = B;
+				if( !update(phi, A0, B0, Scalar(0.5)*(A0.a + B0.a), A, B) ){ break; }
+			}
+			a = A; b = B;
+			if( b.a - a.a <= std::numeric_limits<Scalar>::epsilon() * b.a ){ phi.failed = true; }
+		}
+		iters = phi.iters;
+
+		if( !phi.done ){
+			if( settings.verbose > 0 && !state.deadline.expired() ){ printf("HagerZhang::linesearch Error: LS blocked\n"); }
+			return -1;
+		}
+
+		// The accepted point is the last one evaluated, grad_trial is its gradient
+		fx = phi.last.f;
+		grad.swap(grad_trial);
+		return phi.last.a;
+	}
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
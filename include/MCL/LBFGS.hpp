@@ -30,11 +30,12 @@ namespace optlib {
 // L-BFGS implementation based on Nocedal & Wright Numerical Optimization book (Section 7.2)
 // DIM = dimension of the problem
 // M = history window
+// LS = line search policy (see LineSearch.hpp)
 //
 // Original Author: Ioannis Karamouzas
 //
-template<typename Scalar, int DIM, int M=8>
-class LBFGS : public Minimizer<Scalar,DIM> {
+template<typename Scalar, int DIM, int M=8, template<typename,int> class LS = LineSearch>
+class LBFGS : public MinimizerImpl<LBFGS<Scalar,DIM,M,LS>,Scalar,DIM> {
 private:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 	typedef Eigen::Matrix<Scalar,DIM,M> MatM;
@@ -43,39 +44,68 @@ private:
 public:
 	bool show_denom_warning; // Print out warning for zero denominators
 
-	LBFGS() : show_denom_warning(false) {
+	// If true, the (s,y) history and scaling are kept between calls to minimize,
+	// which helps when solving a sequence of similar problems (e.g. time steps).
+	// The history is dropped if a new pair fails the curvature condition.
+	bool warm_start;
+
+	LBFGS() : show_denom_warning(false), warm_start(false) {
 		this->m_settings.max_iters = 50;
 		show_denom_warning = this->m_settings.verbose > 0 ? true : false;
 	}
 
-	// Returns number of iterations used
-	int minimize(Problem<Scalar,DIM> &problem, VecX &x){
+	// Clears the (s,y) history used by warm starts
+	void reset_history(){ m_ws.clear(); }
+
+	// Adds a pair s = x_k+1 - x_k, y = grad_k+1 - grad_k to the history,
+	// e.g. to warm start from a known curvature. Returns false (and
+	// clears the history) if the pair fails the curvature condition.
+	bool add_history(const VecX &s_k, const VecX &y_k){
+		m_ws.resize(s_k.rows());
+		m_ws.s.col(m_ws.head) = s_k;
+		m_ws.y.col(m_ws.head) = y_k;
+		return m_ws.push();
+	}
 
-		MatM s, y;
-		VecM alpha, rho;
-		VecX grad, q, grad_old, x_old, x_last;
+	// Number of (s,y) pairs currently in the history
+	int history_size() const { return m_ws.n_hist; }
 
-		if( DIM==Eigen::Dynamic ){
-			int dim = x.rows();
-			s = MatM::Zero(dim,M);
-			y = MatM::Zero(dim,M);
-			alpha = VecM::Zero(M);
-			rho = VecM::Zero(M);
-			grad = VecX::Zero(dim);
-			q = VecX::Zero(dim);
-			grad_old = VecX::Zero(dim);
-			x_old = VecX::Zero(dim);
-			x_last = VecX::Zero(dim);
-		}
+protected:
+	friend class MinimizerImpl<LBFGS,Scalar,DIM>;
 
-		problem.gradient(x, grad);
+	// Returns number of iterations used
+	template<typename P>
+	int solve_impl(P &problem, VecX &x){
+
+		// Reuse buffers from the last call if possible
+		m_ws.resize(x.rows());
+		if( !warm_start ){ m_ws.clear(); }
+		MatM &s = m_ws.s;
+		MatM &y = m_ws.y;
+		VecM &alpha = m_ws.alpha;
+		VecM &rho = m_ws.rho;
+		VecX &grad = m_ws.grad;
+		VecX &q = m_ws.q;
+		VecX &p = m_ws.p;
+		VecX &grad_old = m_ws.grad_old;
+		VecX &x_old = m_ws.x_old;
+		VecX &x_last = m_ws.x_last;
+
+		// History is stored in a ring buffer: the newest pair
+		// is at column head-1, the oldest at head-n_hist.
+		const int &head = m_ws.head;
+		const int &n_hist = m_ws.n_hist;
+
+		Scalar fx = problem.gradient(x, grad);
+		this->begin_solve(x, fx);
 
-		Scalar gamma_k = 1.0;
 		Scalar alpha_init = 1.0;
 
 		int global_iter = 0;
 		int max_iters = this->m_settings.max_iters;
 		int verbose = this->m_settings.verbose;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
 
 		for( int k=0; k<max_iters; ++k ){
 
@@ -84,72 +114,117 @@ public:
 			q = grad;
 			global_iter++;
 	
-			// L-BFGS first - loop recursion		
-			int iter = std::min(M, k);
-			for(int i = iter - 1; i >= 0; --i){
-				rho(i) = 1.0 / ((s.col(i)).dot(y.col(i)));
+			// L-BFGS first - loop recursion, newest to oldest
+			for(int j = 0; j < n_hist; ++j){
+				int i = (head - 1 - j + M) % M;
 				alpha(i) = rho(i)*(s.col(i)).dot(q);
-				q = q - alpha(i)*y.col(i);
+				q -= alpha(i)*y.col(i);
 			}
 
-			// L-BFGS second - loop recursion			
-			q = gamma_k*q;
-			for(int i = 0; i < iter; ++i){
+			// L-BFGS second - loop recursion, oldest to newest
+			q *= m_ws.gamma;
+			for(int j = n_hist - 1; j >= 0; --j){
+				int i = (head - 1 - j + M) % M;
 				Scalar beta = rho(i)*q.dot(y.col(i));
-				q = q + (alpha(i) - beta)*s.col(i);
+				q += (alpha(i) - beta)*s.col(i);
 			}
 
 			// is there a descent
 			Scalar dir = q.dot(grad);
 			if(dir <= 0 ){
 				q = grad;
-				max_iters -= k;
-				k = 0;
-				alpha_init = std::min(1.0, 1.0 / grad.template lpNorm<Eigen::Infinity>() );
+				m_ws.clear(); // drop the history
+				alpha_init = std::min( Scalar(1), Scalar(1) / grad.template lpNorm<Eigen::Infinity>() );
 			}
 
-			Scalar rate = this->linesearch(x, -q, problem, alpha_init);
+			p = -q;
+			Scalar rate = this->template linesearch< LS<Scalar,DIM> >(x, p, problem, alpha_init, fx, grad);
 
 			if( rate <= 0 ){
+				if( this->stop_on_deadline(x, fx) ){ break; }
 				if( verbose > 0 ){ printf("LBFGS::minimize: Failure in linesearch\n"); }
+				report.iters = global_iter;
+				report.termination = Termination::LineSearchFailure;
 				return Minimizer<Scalar,DIM>::FAILURE;
 			}
 
+			// The line search also returns the gradient at the new x
 			x_last = x;
 			x -= rate * q;
-			if( problem.converged(x_last,x,grad) ){ break; }
+			if( problem.converged(x_last,x,grad) ){ report.termination = Termination::Converged; }
+			if( this->end_iteration(k, x_last, x, fx, grad) ){ break; }
 
-			problem.gradient(x,grad);
-			VecX s_temp = x - x_old;
-			VecX y_temp = grad - grad_old;
-
-			// update the history
-			if(k < M){
-				s.col(k) = s_temp;
-				y.col(k) = y_temp;
-			}
-			else {
-				s.leftCols(M - 1) = s.rightCols(M - 1).eval();
-				s.rightCols(1) = s_temp;
-				y.leftCols(M - 1) = y.rightCols(M - 1).eval();
-				y.rightCols(1) = y_temp;
-			}
-		
-			Scalar denom = y_temp.dot(y_temp);
+			// update the history, overwriting the oldest pair if full
+			s.col(head) = x - x_old;
+			y.col(head) = grad - grad_old;
+			Scalar denom = y.col(head).squaredNorm();
 			if( std::abs(denom) <= 0 ){
 				if( show_denom_warning ){
 					printf("LBFGS::minimize Warning: Encountered a zero denominator\n");
 				}
+				report.termination = Termination::NoProgress;
 				break;
 			}
-			gamma_k = s_temp.dot(y_temp) / denom;
+			if( !m_ws.push() && verbose > 1 ){
+				printf("LBFGS::minimize: Curvature condition failed, dropping history\n");
+			}
 			alpha_init = 1.0;
 
 		}
 
+		report.iters = global_iter;
 		return global_iter;
 
 	} // end minimize
+
+private:
+	// Buffers that persist between calls to minimize
+	struct Workspace {
+		MatM s, y;
+		VecM alpha, rho; // rho = 1/s.y, computed when a pair is added
+		VecX grad, q, p, grad_old, x_old, x_last;
+		int head, n_hist; // ring buffer of (s,y) pairs
+		Scalar gamma; // initial hessian scale, s.y / y.y of the newest pair
+		Workspace() : head(0), n_hist(0), gamma(1) {}
+
+		void resize(int dim){
+			if( grad.rows() == dim ){ return; }
+			s = MatM::Zero(dim,M);
+			y = MatM::Zero(dim,M);
+			alpha = VecM::Zero(M);
+			rho = VecM::Zero(M);
+			grad = VecX::Zero(dim);
+			q = VecX::Zero(dim);
+			p = VecX::Zero(dim);
+			grad_old = VecX::Zero(dim);
+			x_old = VecX::Zero(dim);
+			x_last = VecX::Zero(dim);
+			clear();
+		}
+
+		void clear(){
+			head = 0;
+			n_hist = 0;
+			gamma = 1;
+		}
+
+		// Adds the pair stored at column head. If it fails the curvature
+		// condition s.y > 0 the history (possibly from a previous solve)
+		// no longer describes the problem, so it is dropped.
+		bool push(){
+			const Scalar yy = y.col(head).squaredNorm();
+			const Scalar sy_k = s.col(head).dot(y.col(head));
+			if( !( sy_k > std::numeric_limits<Scalar>::epsilon()*yy ) ){
+				clear();
+				return false;
+			}
+			rho(head) = Scalar(1) / sy_k;
+			gamma = sy_k / yy;
+			head = (head + 1) % M;
+			n_hist = std::min(n_hist + 1, M);
+			return true;
+		}
+	} m_ws;
 };
 
 }
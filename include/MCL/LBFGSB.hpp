@@ -0,0 +1,376 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MCL_LBFGSB_H
+#define MCL_LBFGSB_H
+
+#include "Minimizer.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace mcl {
+namespace optlib {
+
+//
+// L-BFGS-B for box constrained problems, lower <= x <= upper (see Problem::bounds).
+// Based on Byrd, Lu, Nocedal & Zhu (1995), "A limited memory algorithm for bound
+// constrained optimization", with the projection step of Morales & Nocedal (2011).
+// Each iteration:
+//	1) finds the generalized Cauchy point, the first minimizer of the compact
+//	   L-BFGS model along the projected steepest descent path,
+//	2) minimizes the model over the variables that are free at the Cauchy point,
+//	   and projects the result onto the box,
+//	3) does a projected backtracking line search toward it (see Backtracking.hpp).
+// Without bounds it is similar to LBFGS. The starting point is projected onto the box.
+// Problem::converged is given the projected gradient, which is zero at a constrained minimum.
+//
+// DIM = dimension of the problem
+// M = history window
+//
+template<typename Scalar, int DIM, int M=8>
+class LBFGSB : public MinimizerImpl<LBFGSB<Scalar,DIM,M>,Scalar,DIM> {
+private:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,M> MatM;
+	typedef Eigen::Matrix<Scalar,DIM,2*M> MatW;
+	// Compact representation, at most 2M x 2M so that it stays on the stack
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1,0,2*M,1> Vec2M;
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic,0,2*M,2*M> Mat2M;
+
+public:
+	LBFGSB() {
+		this->m_settings.max_iters = 50;
+	}
+
+protected:
+	friend class MinimizerImpl<LBFGSB,Scalar,DIM>;
+
+	template<typename P>
+	int solve_impl(P &problem, VecX &x){
+
+		// Reuse buffers from the last call if possible
+		const int dim = x.rows();
+		m_ws.resize(dim);
+		m_ws.clear();
+		VecX &lower = m_ws.lower;
+		VecX &upper = m_ws.upper;
+		VecX &grad = m_ws.grad;
+		VecX &grad_old = m_ws.grad_old;
+		VecX &x_old = m_ws.x_old;
+		VecX &pg = m_ws.pg;
+		VecX &d = m_ws.d;
+
+		if( !problem.bounds(lower, upper) ){
+			lower.setConstant( -std::numeric_limits<Scalar>::infinity() );
+			upper.setConstant( std::numeric_limits<Scalar>::infinity() );
+		}
+		x = x.cwiseMax(lower).cwiseMin(upper);
+
+		Scalar fx = problem.gradient(x, grad);
+		this->begin_solve(x, fx);
+
+		int max_iters = this->m_settings.max_iters;
+		int verbose = this->m_settings.verbose;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
+
+		int iter = 0;
+		for( ; iter < max_iters; ++iter ){
+
+			// Already at a stationary point on the box
+			projected_gradient(x, grad, pg);
+			if( pg.template lpNorm<Eigen::Infinity>() <= 0 ){
+				report.termination = Termination::Converged;
+				break;
+			}
+
+			// Step toward the minimizer of the model in the subspace
+			// of the free variables, or to the Cauchy point if that fails
+			compact();
+			cauchy_point(x, grad);
+			subspace_min(x, grad);
+			d = m_ws.x_bar - x;
+			if( !(grad.dot(d) < 0) ){ d = m_ws.x_cp - x; }
+
+			Scalar alpha_init = 1;
+			if( m_ws.n_hist == 0 ){
+				alpha_init = std::min( Scalar(1), Scalar(1) / d.template lpNorm<Eigen::Infinity>() );
+			}
+
+			x_old = x;
+			grad_old = grad;
+			int ls_iters = 1;
+			Scalar rate = ProjectedBacktracking<Scalar,DIM>::search(this->m_settings, this->m_ls_state, x, d, lower, upper,
+				problem, alpha_init, fx, grad, m_ws.x_trial, m_ws.grad_trial, ls_iters);
+			report.ls_iters += ls_iters;
+
+			if( rate <= 0 ){
+				if( this->stop_on_deadline(x, fx) ){ break; }
+				if( verbose > 0 ){ printf("LBFGSB::minimize: Failure in linesearch\n"); }
+				report.iters = iter;
+				report.termination = Termination::LineSearchFailure;
+				return Minimizer<Scalar,DIM>::FAILURE;
+			}
+
+			// The line search returns the projected point and its gradient
+			x = m_ws.x_trial;
+			projected_gradient(x, grad, pg);
+			if( problem.converged(x_old,x,pg) ){ report.termination = Termination::Converged; }
+			if( this->end_iteration(iter, x_old, x, fx, grad) ){ break; }
+
+			// Add the pair to the history, skipped if it fails the curvature condition
+			m_ws.s.col(m_ws.head) = x - x_old;
+			m_ws.y.col(m_ws.head) = grad - grad_old;
+			if( m_ws.s.col(m_ws.head).squaredNorm() <= 0 ){
+				report.termination = Termination::NoProgress;
+				break;
+			}
+			if( !m_ws.push() && verbose > 1 ){
+				printf("LBFGSB::minimize: Curvature condition failed, skipping pair\n");
+			}
+		}
+
+		report.iters = iter;
+		return iter;
+
+	} // end minimize
+
+	// Zero for the components of the gradient that point out of the box at x
+	inline void projected_gradient(const VecX &x, const VecX &grad, VecX &pg) const {
+		pg = grad;
+		const int dim = x.rows();
+		for( int i=0; i<dim; ++i ){
+			if( x[i] <= m_ws.lower[i] && grad[i] > 0 ){ pg[i] = 0; }
+			else if( x[i] >= m_ws.upper[i] && grad[i] < 0 ){ pg[i] = 0; }
+		}
+	}
+
+	// Compact form B = theta I - W Minv W^T with W = [Y, theta S] of the
+	// history, oldest to newest, and Minv = [-D, L^T; L, theta S^T S]^-1
+	// where D = diag(s_i^T y_i) and L is the strict lower triangle of S^T Y.
+	void compact(){
+		const int k = m_ws.n_hist;
+		Scalar &theta = m_ws.theta;
+		theta = 1;
+		if( k == 0 ){
+			m_ws.Minv.resize(0,0);
+			return;
+		}
+
+		int newest = (m_ws.head - 1 + M) % M;
+		theta = m_ws.y.col(newest).squaredNorm() / m_ws.sy(newest);
+		for( int j=0; j<k; ++j ){
+			int cj = (m_ws.head - k + j + M) % M;
+			m_ws.W.col(j) = m_ws.y.col(cj);
+			m_ws.W.col(k+j) = theta * m_ws.s.col(cj);
+		}
+
+		Mat2M K = Mat2M::Zero(2*k,2*k);
+		for( int i=0; i<k; ++i ){
+			int ci = (m_ws.head - k + i + M) % M;
+			K(i,i) = -m_ws.sy(ci);
+			for( int j=0; j<k; ++j ){
+				int cj = (m_ws.head - k + j + M) % M;
+				if( i > j ){
+					Scalar L_ij = m_ws.s.col(ci).dot(m_ws.y.col(cj));
+					K(k+i,j) = L_ij;
+					K(j,k+i) = L_ij;
+				}
+				if( j <= i ){
+					Scalar StS_ij = theta * m_ws.s.col(ci).dot(m_ws.s.col(cj));
+					K(k+i,k+j) = StS_ij;
+					K(k+j,k+i) = StS_ij;
+				}
+			}
+		}
+		m_ws.Minv = K.inverse();
+	}
+
+	// Generalized Cauchy point x_cp (Byrd et al. Algorithm CP), the first local
+	// minimizer of the model along the path P(x - t grad), t >= 0. Also sets
+	// c = W^T (x_cp - x), used by the subspace minimization.
+	void cauchy_point(const VecX &x, const VecX &grad){
+		const int dim = x.rows();
+		const int k2 = 2*m_ws.n_hist;
+		const Scalar theta = m_ws.theta;
+		const Mat2M &Minv = m_ws.Minv;
+		VecX &x_cp = m_ws.x_cp;
+		VecX &dir = m_ws.dir;
+		std::vector< std::pair<Scalar,int> > &breaks = m_ws.breaks;
+
+		// Breakpoints t_i where variable i hits a bound along -grad
+		const Scalar inf = std::numeric_limits<Scalar>::infinity();
+		breaks.clear();
+		for( int i=0; i<dim; ++i ){
+			Scalar t = inf;
+			if( grad[i] < 0 ){ t = (x[i] - m_ws.upper[i]) / grad[i]; }
+			else if( grad[i] > 0 ){ t = (x[i] - m_ws.lower[i]) / grad[i]; }
+			dir[i] = t > 0 ? -grad[i] : 0;
+			if( t > 0 && t < inf ){ breaks.emplace_back(t,i); }
+		}
+		std::sort( breaks.begin(), breaks.end() );
+
+		x_cp = x;
+		Vec2M p = m_ws.W.leftCols(k2).transpose() * dir;
+		Vec2M c = Vec2M::Zero(k2);
+		Scalar f1 = -dir.squaredNorm();
+		Scalar f2 = -theta*f1 - p.dot(Minv*p);
+		Scalar dt_min = -f1 / f2;
+		Scalar t_old = 0;
+
+		// Fix variables at their breakpoints until the model minimizer is reached
+		for( size_t b=0; b<breaks.size(); ++b ){
+			const Scalar t = breaks[b].first;
+			const int i = breaks[b].second;
+			const Scalar dt = t - t_old;
+			if( dt_min < dt ){ break; }
+
+			x_cp[i] = dir[i] > 0 ? m_ws.upper[i] : m_ws.lower[i];
+			const Scalar z = x_cp[i] - x[i];
+			const Scalar g = grad[i];
+			c += dt*p;
+			Vec2M w = m_ws.W.row(i).head(k2).transpose();
+			Vec2M Mw = Minv*w;
+			f1 += dt*f2 + g*g + theta*g*z - g*Mw.dot(c);
+			f2 += -theta*g*g - Scalar(2)*g*Mw.dot(p) - g*g*Mw.dot(w);
+			f2 = std::max( f2, std::numeric_limits<Scalar>::epsilon()*theta );
+			p += g*w;
+			dir[i] = 0;
+			dt_min = -f1 / f2;
+			t_old = t;
+		}
+
+		dt_min = std::max( dt_min, Scalar(0) );
+		t_old += dt_min;
+		for( int i=0; i<dim; ++i ){
+			if( dir[i] != 0 ){ x_cp[i] = x[i] + t_old*dir[i]; }
+		}
+		m_ws.c = c + dt_min*p;
+	}
+
+	// Direct primal subspace minimization (Byrd et al. Section 5.1) of the model
+	// over the variables free at x_cp, projected onto the box (Morales & Nocedal).
+	void subspace_min(const VecX &x, const VecX &grad){
+		const int dim = x.rows();
+		const int k2 = 2*m_ws.n_hist;
+		const Scalar theta = m_ws.theta;
+		const Mat2M &Minv = m_ws.Minv;
+		const VecX &x_cp = m_ws.x_cp;
+		VecX &x_bar = m_ws.x_bar;
+		VecX &r = m_ws.r;
+		std::vector<int> &free_vars = m_ws.free_vars;
+
+		x_bar = x_cp;
+		free_vars.clear();
+		for( int i=0; i<dim; ++i ){
+			if( x_cp[i] > m_ws.lower[i] && x_cp[i] < m_ws.upper[i] ){ free_vars.push_back(i); }
+		}
+		if( free_vars.empty() ){ return; }
+
+		// Reduced gradient of the model at x_cp, r = Z^T (grad + theta (x_cp - x) - W Minv c)
+		Vec2M Mc = Minv * m_ws.c;
+		Vec2M v = Vec2M::Zero(k2);
+		Mat2M WtW = Mat2M::Zero(k2,k2);
+		for( size_t f=0; f<free_vars.size(); ++f ){
+			const int i = free_vars[f];
+			r[i] = grad[i] + theta*(x_cp[i] - x[i]) - m_ws.W.row(i).head(k2).dot(Mc);
+			if( k2 > 0 ){
+				v += r[i] * m_ws.W.row(i).head(k2).transpose();
+				WtW.noalias() += m_ws.W.row(i).head(k2).transpose() * m_ws.W.row(i).head(k2);
+			}
+		}
+
+		// du = -r/theta - Z^T W (I - Minv W^T Z Z^T W / theta)^-1 Minv W^T Z r / theta^2
+		if( k2 > 0 ){
+			v = Minv * v;
+			Mat2M N = Mat2M::Identity(k2,k2) - (Minv * WtW) / theta;
+			v = N.partialPivLu().solve(v);
+		}
+		for( size_t f=0; f<free_vars.size(); ++f ){
+			const int i = free_vars[f];
+			Scalar du = -r[i]/theta;
+			if( k2 > 0 ){ du -= m_ws.W.row(i).head(k2).dot(v) / (theta*theta); }
+			x_bar[i] = std::min( std::max( x_cp[i] + du, m_ws.lower[i] ), m_ws.upper[i] );
+		}
+	}
+
+private:
+	// Buffers that persist between calls to minimize
+	struct Workspace {
+		MatM s, y; // ring buffer of (s,y) pairs, as in LBFGS
+		Eigen::Matrix<Scalar,M,1> sy;
+		int head, n_hist;
+		MatW W; // compact form, first 2*n_hist columns
+		Mat2M Minv;
+		Scalar theta; // B0 = theta I
+		Vec2M c; // W^T (x_cp - x)
+		VecX lower, upper, grad, grad_old, x_old, pg, d;
+		VecX x_cp, x_bar, dir, r, x_trial, grad_trial;
+		std::vector< std::pair<Scalar,int> > breaks;
+		std::vector<int> free_vars;
+		Workspace() : head(0), n_hist(0), theta(1) {}
+
+		void resize(int dim){
+			if( grad.rows() == dim ){ return; }
+			s = MatM::Zero(dim,M);
+			y = MatM::Zero(dim,M);
+			sy = Eigen::Matrix<Scalar,M,1>::Zero();
+			W = MatW::Zero(dim,2*M);
+			lower = VecX::Zero(dim);
+			upper = VecX::Zero(dim);
+			grad = VecX::Zero(dim);
+			grad_old = VecX::Zero(dim);
+			x_old = VecX::Zero(dim);
+			pg = VecX::Zero(dim);
+			d = VecX::Zero(dim);
+			x_cp = VecX::Zero(dim);
+			x_bar = VecX::Zero(dim);
+			dir = VecX::Zero(dim);
+			r = VecX::Zero(dim);
+			x_trial = VecX::Zero(dim);
+			grad_trial = VecX::Zero(dim);
+			breaks.reserve(dim);
+			free_vars.reserve(dim);
+			clear();
+		}
+
+		void clear(){
+			head = 0;
+			n_hist = 0;
+		}
+
+		// Adds the pair stored at column head if s.y > 0
+		bool push(){
+			const Scalar yy = y.col(head).squaredNorm();
+			const Scalar sy_k = s.col(head).dot(y.col(head));
+			if( !( sy_k > std::numeric_limits<Scalar>::epsilon()*yy ) ){ return false; }
+			sy(head) = sy_k;
+			head = (head + 1) % M;
+			n_hist = std::min(n_hist + 1, M);
+			return true;
+		}
+	} m_ws;
+};
+
+}
+}
+
+#endif
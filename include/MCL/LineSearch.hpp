@@ -0,0 +1,112 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_LINESEARCH_H
+#define MCL_LINESEARCH_H
+
+#include "LineSearchState.hpp"
+#include "Backtracking.hpp"
+#include "MoreThuente.hpp"
+#include "WolfeBisection.hpp"
+#include "HagerZhang.hpp"
+#include "ParallelBacktracking.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Line searches are policies passed to the solvers as a template parameter,
+// e.g. LBFGS<double,3,8,MoreThuente>. A policy is a class template on <Scalar,DIM>
+// with a static function
+//
+//	template<typename P>
+//	static Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p,
+//		P &problem, Scalar alpha0, Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters);
+//
+// that returns the step length (or -1 on failure). fx and grad are f(x) and its
+// gradient on input, and f(x+alpha*p) and its gradient on output. x_trial and
+// grad_trial are preallocated buffers, iters is the number of trial steps.
+// See Backtracking.hpp, MoreThuente.hpp, WolfeBisection.hpp, HagerZhang.hpp,
+// and ParallelBacktracking.hpp.
+//
+
+// Always takes the full step (LSMethod::None)
+template<typename Scalar, int DIM>
+class NoLineSearch {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		(void)(settings); (void)(state); (void)(alpha0); (void)(grad_trial);
+		iters = 1;
+		x_trial = x + p;
+		fx = problem.gradient(x_trial, grad);
+		return 1;
+	}
+
+}; // end class NoLineSearch
+
+// The default policy of the solvers, selects the line search
+// at run time with settings.ls_method.
+template<typename Scalar, int DIM>
+class LineSearch {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		switch( settings.ls_method ){
+			default: break;
+			case LSMethod::None: {
+				return NoLineSearch<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+			case LSMethod::MoreThuente: {
+				return MoreThuente<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+			case LSMethod::BacktrackingCubic: {
+				return BacktrackingCubic<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+			case LSMethod::WeakWolfeBisection: {
+				return WolfeBisection<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+			case LSMethod::HagerZhang: {
+				return HagerZhang<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+			case LSMethod::Nonmonotone: {
+				return NonmonotoneBacktracking<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+			case LSMethod::ParallelBacktracking: {
+				return ParallelBacktracking<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+			}
+		}
+		return Backtracking<Scalar,DIM>::search(settings, state, x, p, problem, alpha0, fx, grad, x_trial, grad_trial, iters);
+	}
+
+}; // end class LineSearch
+
+} // ns optlib
+} // ns mcl
+
+#endif
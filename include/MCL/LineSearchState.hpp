@@ -0,0 +1,93 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_LINESEARCHSTATE_H
+#define MCL_LINESEARCHSTATE_H
+
+#include "Settings.hpp"
+#include "ThreadPool.hpp"
+#include <Eigen/Core>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace mcl {
+namespace optlib {
+
+//
+// State of a solver passed to its line searches (Minimizer::linesearch), kept
+// out of MinimizerSettings so that settings can be copied and shared freely.
+// A copy starts without the state of the original (e.g. Minimizer::clone),
+// so that solvers used from different threads never share it.
+//
+template<typename Scalar, int DIM>
+struct LineSearchState {
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	// Started from settings.max_time by the solver, line searches fail once it expires
+	Deadline deadline;
+
+	// Used by ParallelBacktracking: the thread pool, created on first use,
+	// and buffers for every pool thread and trial step of a pass
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<VecX, Eigen::aligned_allocator<VecX> > pool_x;
+	std::vector<Scalar> pool_alpha, pool_fx;
+
+	// Used by NonmonotoneBacktracking (see NonmonotoneSettings): the Zhang-Hager
+	// average c with weight q, and the last nm.window objectives for Grippo's max
+	Scalar nm_c, nm_q;
+	std::vector<Scalar> nm_f;
+	int nm_count;
+
+	LineSearchState() : nm_c(0), nm_q(0), nm_count(0) {}
+	LineSearchState(const LineSearchState &other) : nm_c(0), nm_q(0), nm_count(0) { (void)(other); }
+	LineSearchState& operator=(const LineSearchState &other){ (void)(other); return *this; }
+
+	// Called by the solver before the first line search of a solve
+	void begin_solve(const MinimizerSettings<Scalar> &settings){
+		deadline.start( settings.max_time );
+		nm_c = 0;
+		nm_q = 0;
+		nm_count = 0;
+		nm_f.resize( std::max( settings.nm.window, 0 ) );
+	}
+
+	// Adds f(x) of the current iterate to the nonmonotone state and returns the reference
+	Scalar nonmonotone_reference(const NonmonotoneSettings<Scalar> &nm, Scalar fx){
+		const int window = int(nm_f.size());
+		if( window > 0 ){
+			nm_f[ nm_count % window ] = fx;
+			nm_count++;
+			const int n = std::min( nm_count, window );
+			return *std::max_element( nm_f.begin(), nm_f.begin()+n );
+		}
+		const Scalar q = nm.eta*nm_q + Scalar(1);
+		nm_c = ( nm.eta*nm_q*nm_c + fx ) / q;
+		nm_q = q;
+		return nm_c;
+	}
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
@@ -23,27 +23,27 @@
 #define MCL_MINIMIZER_H
 
 #include "Problem.hpp"
-#include "Backtracking.hpp"
-#include "MoreThuente.hpp"
-#include "WolfeBisection.hpp"
+#include "Settings.hpp"
+#include "LineSearch.hpp"
+#include "SolveReport.hpp"
 #include <memory>
+#include <functional>
+#include <stdexcept>
 
 namespace mcl {
 namespace optlib {
 
-// The different line search methods currently implemented
-enum class LSMethod {
-	None = 0, // use step length = 1, not recommended
-	MoreThuente, // TODO test this one for correctness
-	Backtracking, // basic backtracking with sufficient decrease
-	BacktrackingCubic, // backtracking with cubic interpolation
-	WeakWolfeBisection // slow
-};
-
-// Trust region subproblem method (see TrustRegion.hpp)
-enum class TRMethod {
-	CauchyPoint,
-	DogLeg
+//
+// State of a solver after an iteration, passed to Minimizer::m_callback
+//
+template<typename Scalar, int DIM>
+struct IterationInfo {
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	int iter; // iteration index, starting at 0
+	Scalar fx; // objective at x
+	const VecX &x; // the new iterate
+	const VecX &grad; // gradient at x
+	const VecX &step; // x minus the last iterate
 };
 
 //
@@ -55,58 +55,164 @@ public:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 	static const int FAILURE = -1; // returned by minimize if an error is encountered
 
-	struct Settings {
-		int verbose; // higher = more printouts
-		int max_iters; // usually changed by derived constructors
-		int ls_max_iters; // max line search iters
-		Scalar ls_decrease; // sufficient decrease param
-		LSMethod ls_method; // see LSMethod (above)
-		TRMethod tr_method; // see TRMethod (above)
-
-		Settings() : verbose(0), max_iters(100),
-			ls_max_iters(100000), ls_decrease(1e-4),
-			ls_method(LSMethod::BacktrackingCubic),
-			tr_method(TRMethod::DogLeg)
-			{}
-	} m_settings;
+	typedef MinimizerSettings<Scalar> Settings; // see Settings.hpp
+	Settings m_settings;
+
+	// Statistics of the last call to minimize (see SolveReport.hpp)
+	SolveReport m_report;
+
+	// Called after every accepted step (including the last), return false
+	// to stop the solver with Termination::Callback. Not called if empty.
+	// It is copied by clone, so ParallelSolve calls the same callback from
+	// all of its threads at once: it must be thread safe if used there.
+	std::function<bool(const IterationInfo<Scalar,DIM>&)> m_callback;
 
 	//
-	// Performs optimization
+	// Performs optimization, returns the number of iterations or FAILURE.
+	// If MCL_SOLVE_REPORT, the problem evaluations are counted and timed.
+	// Solvers derived from MinimizerImpl (below) also have a templated minimize for
+	// problem types known at compile time (see StaticProblem.hpp), which avoids
+	// virtual calls.
+	// New solvers implement solve (below) instead of overriding minimize. Solvers
+	// written against the old interface, which override minimize, still work
+	// but do not fill in m_report (see README).
 	//
-	virtual int minimize(Problem<Scalar,DIM> &problem, VecX &x) = 0;
+	virtual int minimize(Problem<Scalar,DIM> &problem, VecX &x){
+		ReportScope<Scalar,DIM,Problem<Scalar,DIM> > scope(problem, m_report);
+		return solve(scope.problem(), x);
+	}
+
+	Minimizer() : m_best_fx(0) {}
+	virtual ~Minimizer(){}
+
+	// Returns a copy of the solver (settings and buffers) that can be
+	// used by another thread, see ParallelSolve.hpp. Implemented by
+	// MinimizerImpl, other solvers only need it for ParallelSolve.
+	virtual std::unique_ptr< Minimizer<Scalar,DIM> > clone() const {
+		throw std::runtime_error("Minimizer::clone Error: clone not implemented");
+	}
 
 
 protected:
 
-	// Line search method/options can be changed through m_settings.
-	Scalar linesearch(const VecX &x, const VecX &p, Problem<Scalar,DIM> &prob, double alpha0) const {
-		double alpha = alpha0;
-		int mi = m_settings.ls_max_iters;
-		int v = m_settings.verbose;
-		Scalar sd = m_settings.ls_decrease;
-		switch( m_settings.ls_method ){
-			default:{
-				alpha = Backtracking<Scalar,DIM>::search(v, mi, sd, x, p, prob, alpha0);
-			} break;
-			case LSMethod::None: { alpha = 1.0; } break;
-			case LSMethod::MoreThuente: {
-				alpha = MoreThuente<Scalar,DIM>::search(x, p, prob, alpha0);
-			} break;
-			case LSMethod::Backtracking: {
-				alpha = Backtracking<Scalar,DIM>::search(v, mi, sd, x, p, prob, alpha0);
-			} break;
-			case LSMethod::BacktrackingCubic: {
-				alpha = BacktrackingCubic<Scalar,DIM>::search(v, mi, sd, x, p, prob, alpha0);
-			} break;
-			case LSMethod::WeakWolfeBisection: {
-				alpha = WolfeBisection<Scalar,DIM>::search(v, mi, x, p, prob, alpha0);
-			} break;
+	// Implemented by the derived solvers, usually by calling their templated
+	// solve_impl. Should set m_report.iters and m_report.termination.
+	// Not called by solvers that override minimize instead.
+	virtual int solve(Problem<Scalar,DIM> &problem, VecX &x){
+		(void)(problem); (void)(x);
+		throw std::runtime_error("Minimizer::solve Error: solve (or minimize) not implemented");
+	}
+
+	// Same as above for the problem wrapped by minimize if MCL_SOLVE_REPORT.
+	// The default solves the wrapped problem directly, so its evaluations are
+	// not counted. Declared regardless of MCL_SOLVE_REPORT, so that the vtable
+	// is the same in translation units built with and without it.
+	virtual int solve(ReportProblem<Scalar,DIM> &problem, VecX &x){ return solve(problem.wrapped(), x); }
+
+	// Preallocated line search buffers, resized only when the dimension changes.
+	VecX m_ls_x; // trial point x + alpha*p
+	VecX m_ls_grad; // gradient at trial point
+	LineSearchState<Scalar,DIM> m_ls_state; // passed to the line searches
+
+	// Lowest objective seen, returned if the deadline expires
+	VecX m_best_x;
+	Scalar m_best_fx;
+	VecX m_step; // buffer for IterationInfo::step
+
+	// Called by the solvers before the first iteration with f(x).
+	// Starts the deadline (m_settings.max_time).
+	void begin_solve(const VecX &x, Scalar fx){
+		m_ls_state.begin_solve( m_settings );
+		if( m_ls_state.deadline.active ){
+			m_best_x = x;
+			m_best_fx = fx;
+		}
+	}
+
+	// Called by the solvers after every accepted step from x_last to x, including
+	// the last one (after setting Termination::Converged). Runs the callback and
+	// checks the deadline, returns true (and sets m_report.termination) if the
+	// solver should stop.
+	bool end_iteration(int iter, const VecX &x_last, VecX &x, Scalar fx, const VecX &grad){
+		const bool converged = m_report.termination == Termination::Converged;
+		if( m_ls_state.deadline.active && fx < m_best_fx ){
+			m_best_x = x;
+			m_best_fx = fx;
+		}
+		if( m_callback ){
+			m_step = x - x_last;
+			IterationInfo<Scalar,DIM> info = { iter, fx, x, grad, m_step };
+			if( !m_callback(info) ){
+				if( !converged ){ m_report.termination = Termination::Callback; }
+				return true;
+			}
+		}
+		return converged || stop_on_deadline(x, fx);
+	}
+
+	// If the deadline has expired, sets x to the best iterate (if worse than it)
+	// and returns true. Also checked by the solvers when a line search fails,
+	// since the line searches give up once the deadline expires.
+	bool stop_on_deadline(VecX &x, Scalar fx){
+		if( !m_ls_state.deadline.expired() ){ return false; }
+		if( fx > m_best_fx ){ x = m_best_x; }
+		m_report.termination = Termination::Deadline;
+		return true;
+	}
+
+	// Runs the line search policy LS (see LineSearch.hpp) with m_settings.
+	// On input fx and grad are the objective and gradient at x, which
+	// the solver has already computed. On output they are the objective
+	// and gradient at the accepted point x + alpha*p.
+	template<typename LS, typename P>
+	Scalar linesearch(const VecX &x, const VecX &p, P &prob, Scalar alpha0, Scalar &fx, VecX &grad) {
+		if( m_ls_x.rows() != x.rows() ){
+			m_ls_x = VecX::Zero(x.rows());
+			m_ls_grad = VecX::Zero(x.rows());
 		}
+		int ls_iters = 1;
+		Scalar alpha = LS::search(m_settings, m_ls_state, x, p, prob, alpha0, fx, grad, m_ls_x, m_ls_grad, ls_iters);
+		m_report.ls_iters += ls_iters;
 		return alpha;
 	} // end do linesearch
 
 }; // class minimizer
 
+//
+// Base class of the solvers (CRTP). Derived implements
+//
+//	template<typename P> int solve_impl(P &problem, VecX &x);
+//
+// for any problem type P with the interface of Problem, and declares
+// MinimizerImpl a friend if solve_impl is not public. MinimizerImpl
+// implements clone, solve and the templated minimize with it.
+//
+template<typename Derived, typename Scalar, int DIM>
+class MinimizerImpl : public Minimizer<Scalar,DIM> {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	std::unique_ptr< Minimizer<Scalar,DIM> > clone() const {
+		return std::unique_ptr< Minimizer<Scalar,DIM> >( new Derived(static_cast<const Derived&>(*this)) );
+	}
+
+	using Minimizer<Scalar,DIM>::minimize;
+
+	// Minimize a problem type known at compile time (e.g. a StaticProblem),
+	// so that its functions can be inlined into the solver.
+	template<typename P>
+	int minimize(P &problem, VecX &x){
+		ReportScope<Scalar,DIM,P> scope(problem, this->m_report);
+		return derived().solve_impl(scope.problem(), x);
+	}
+
+protected:
+	int solve(Problem<Scalar,DIM> &problem, VecX &x){ return derived().solve_impl(problem, x); }
+	int solve(ReportProblem<Scalar,DIM> &problem, VecX &x){ return derived().solve_impl(problem, x); }
+
+	inline Derived &derived(){ return *static_cast<Derived*>(this); }
+};
+
 } // ns optlib
 } // ns mcl
 
@@ -0,0 +1,163 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_MIXEDPROBLEM_H
+#define MCL_MIXEDPROBLEM_H
+
+#include "Problem.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Mixed precision: a problem evaluated in LowScalar (float) solved in Scalar (double).
+// The energy and its derivatives use the faster, smaller LowScalar, while the
+// solver keeps its iterate, dot products, and history (e.g. L-BFGS) in Scalar:
+//
+//	MyFloatProblem p; // Problem<float,DIM>
+//	MixedProblem<double,DIM> mixed(p);
+//	LBFGS<double,DIM> solver;
+//	solver.minimize(mixed, x); // x is double
+//
+// Inputs are rounded to LowScalar before every evaluation and the results are
+// widened back, using preallocated buffers. Newton steps (solve_hessian and
+// hessian_newton) and sparsity are those of the low precision problem. The low precision problem is not owned.
+// The buffers are shared, so value is not safe to call concurrently.
+//
+template<typename Scalar, int DIM, typename LowScalar=float>
+class MixedProblem : public Problem<Scalar,DIM> {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+	typedef Eigen::SparseMatrix<Scalar> SparseMat;
+	typedef Problem<LowScalar,DIM> LowProblem;
+	typedef Eigen::Matrix<LowScalar,DIM,1> LowVecX;
+	typedef Eigen::Matrix<LowScalar,DIM,DIM> LowMatX;
+	typedef Eigen::SparseMatrix<LowScalar> LowSparseMat;
+
+	LowProblem *m_problem;
+
+	explicit MixedProblem(LowProblem &problem) : m_problem(&problem) {}
+
+	bool converged(const VecX &x0, const VecX &x1, const VecX &grad){
+		m_x = x0.template cast<LowScalar>();
+		m_v = x1.template cast<LowScalar>();
+		m_grad = grad.template cast<LowScalar>();
+		return m_problem->converged(m_x, m_v, m_grad);
+	}
+
+	Scalar value(const VecX &x){
+		m_x = x.template cast<LowScalar>();
+		return Scalar( m_problem->value(m_x) );
+	}
+
+	Scalar gradient(const VecX &x, VecX &grad){
+		m_x = x.template cast<LowScalar>();
+		m_grad = grad.template cast<LowScalar>();
+		Scalar fx = m_problem->gradient(m_x, m_grad);
+		grad = m_grad.template cast<Scalar>();
+		return fx;
+	}
+
+	void hessian(const VecX &x, MatX &hess){
+		m_x = x.template cast<LowScalar>();
+		m_hess = hess.template cast<LowScalar>();
+		m_problem->hessian(m_x, m_hess);
+		hess = m_hess.template cast<Scalar>();
+	}
+
+	bool hessian_pattern(SparseMat &pattern){
+		if( !m_problem->hessian_pattern(m_sparse_hess) ){ return false; }
+		pattern = m_sparse_hess.template cast<Scalar>();
+		return true;
+	}
+
+	bool bounds(VecX &lower, VecX &upper){
+		if( !m_problem->bounds(m_x, m_v) ){ return false; }
+		lower = m_x.template cast<Scalar>();
+		upper = m_v.template cast<Scalar>();
+		return true;
+	}
+
+	bool precondition(const VecX &x, const VecX &grad, VecX &z){
+		m_x = x.template cast<LowScalar>();
+		m_grad = grad.template cast<LowScalar>();
+		if( !m_problem->precondition(m_x, m_grad, m_v) ){ return false; }
+		z = m_v.template cast<Scalar>();
+		return true;
+	}
+
+	bool is_sparse(){ return m_problem->is_sparse(); }
+
+	void sparse_hessian(const VecX &x, SparseMat &hess){
+		m_x = x.template cast<LowScalar>();
+		m_problem->sparse_hessian(m_x, m_sparse_hess);
+		hess = m_sparse_hess.template cast<Scalar>();
+	}
+
+	void solve_hessian(const VecX &x, const VecX &grad, VecX &dx){
+		m_x = x.template cast<LowScalar>();
+		m_grad = grad.template cast<LowScalar>();
+		m_v = dx.template cast<LowScalar>();
+		m_problem->solve_hessian(m_x, m_grad, m_v);
+		dx = m_v.template cast<Scalar>();
+	}
+
+	void hessian_newton(const VecX &x, const VecX &grad, MatX &hess, VecX &dx){
+		m_x = x.template cast<LowScalar>();
+		m_grad = grad.template cast<LowScalar>();
+		m_hess = hess.template cast<LowScalar>();
+		m_v = dx.template cast<LowScalar>();
+		m_problem->hessian_newton(m_x, m_grad, m_hess, m_v);
+		hess = m_hess.template cast<Scalar>();
+		dx = m_v.template cast<Scalar>();
+	}
+
+	void sparse_hessian_newton(const VecX &x, const VecX &grad, SparseMat &hess, VecX &dx){
+		m_x = x.template cast<LowScalar>();
+		m_grad = grad.template cast<LowScalar>();
+		m_v = dx.template cast<LowScalar>();
+		m_problem->sparse_hessian_newton(m_x, m_grad, m_sparse_hess, m_v);
+		hess = m_sparse_hess.template cast<Scalar>();
+		dx = m_v.template cast<Scalar>();
+	}
+
+	void hessian_vec(const VecX &x, const VecX &v, VecX &Hv){
+		m_x = x.template cast<LowScalar>();
+		m_v = v.template cast<LowScalar>();
+		m_Hv = Hv.template cast<LowScalar>();
+		m_problem->hessian_vec(m_x, m_v, m_Hv);
+		Hv = m_Hv.template cast<Scalar>();
+	}
+
+protected:
+	// Buffers in low precision
+	LowVecX m_x, m_v, m_grad, m_Hv;
+	LowMatX m_hess;
+	LowSparseMat m_sparse_hess;
+
+}; // end class MixedProblem
+
+} // ns optlib
+} // ns mcl
+
+#endif
@@ -25,6 +25,7 @@
 #define MCL_MORETHUENTE_H
 
 #include "Problem.hpp"
+#include "LineSearchState.hpp"
 
 namespace mcl {
 namespace optlib {
@@ -36,13 +37,26 @@ private:
 
 public:
 
-	static inline Scalar search(const VectorX &x, const VectorX &p, Problem<Scalar,DIM> &problem, Scalar alpha0){
+	// fx and grad are f(x) and its gradient on input, and f(x+alpha*p)
+	// and its gradient at the returned alpha on output.
+	// x_trial and grad_trial are preallocated buffers (same size as x)
+	// iters = number of trial steps on output
+	// The tolerances are fixed (see cvsrch), settings are not used.
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VectorX &x, const VectorX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VectorX &grad, VectorX &x_trial, VectorX &grad_trial, int &iters){
+		(void)(settings);
 		Scalar alpha = alpha0;
-		cvsrch(problem, x, alpha, p);
+		cvsrch(problem, x, fx, grad, alpha, p, x_trial, grad_trial, iters, state.deadline);
 		return alpha;
 	}
 
-	static void cvsrch(Problem<Scalar,DIM> &problem, const VectorX &x0, Scalar &stp, const VectorX &s) {
+	// f0 and g0 are the value and gradient at x0 on input, and at x0 + stp*s on output.
+	// stp is set to -1 if s is not a descent direction or the deadline expires.
+	// nfev = number of function evaluations on output
+	template<typename P>
+	static void cvsrch(P &problem, const VectorX &x0, Scalar &f0, VectorX &g0,
+		Scalar &stp, const VectorX &s, VectorX &x, VectorX &g, int &nfev, const Deadline &deadline) {
 		int info           = 0;
 		int infoc          = 1;
 		const Scalar xtol   = 1e-15;
@@ -52,17 +66,13 @@ public:
 		const Scalar stpmax = 1e15;
 		const Scalar xtrapf = 4;
 		const int maxfev   = 20;
-		int nfev           = 0;
-		int dim = x0.rows();
+		nfev               = 0;
 
-		VectorX g;
-		if( DIM == Eigen::Dynamic ){ g = VectorX::Zero(dim); }
-		else{ g.setZero(); }
-
-		Scalar f = problem.gradient(x0, g);
-		Scalar dginit = g.dot(s);
-		if (dginit >= 0.0) {
+		Scalar f = f0;
+		Scalar dginit = g0.dot(s);
+		if (dginit >= Scalar(0)) {
 			// no descent direction
+			stp = -1;
 			return;
 		}
 
@@ -73,7 +83,6 @@ public:
 		Scalar dgtest     = ftol * dginit;
 		Scalar width      = stpmax - stpmin;
 		Scalar width1     = 2 * width;
-		VectorX x = x0.eval();
 
 		Scalar stx        = 0.0;
 		Scalar fx         = finit;
@@ -89,6 +98,12 @@ public:
 		int iter = 0;
 		for( ; iter<max_iters; ++iter ){
 
+			// out of time, f0 and g0 are unchanged
+			if( deadline.expired() ){
+				stp = -1;
+				return;
+			}
+
 			// make sure we stay in the interval when setting min/max-step-width
 			if (brackt) {
 				stmin = std::min(stx, sty);
@@ -133,12 +148,15 @@ public:
 			if (brackt & (stmax - stmin <= xtol * stmax))
 				info = 2;
 	
-			if ((f <= ftest1) & (fabs(dg) <= gtol * (-dginit)))
+			if ((f <= ftest1) & (std::abs(dg) <= gtol * (-dginit)))
 				info = 1;
 
 			// terminate when convergence reached
-			if (info != 0)
+			if (info != 0){
+				f0 = f;
+				g0.swap(g);
 				return;
+			}
 
 			if (stage1 & (f <= ftest1) & (dg >= std::min(ftol, gtol)*dginit))
 				stage1 = false;
@@ -163,11 +181,11 @@ public:
 			}
 
 			if (brackt) {
-				if (fabs(sty - stx) >= 0.66 * width1)
-					stp = stx + 0.5 * (sty - stx);
+				if (std::abs(sty - stx) >= Scalar(0.66) * width1)
+					stp = stx + Scalar(0.5) * (sty - stx);
 
 				width1 = width;
-				width = fabs(sty - stx);
+				width = std::abs(sty - stx);
 			}
 
 		} // end while true
@@ -185,12 +203,12 @@ public:
 		bool bound = false;
 
 		// Check the input parameters for errors.
-		if ((brackt & ((stp <= std::min(stx, sty) ) | (stp >= std::max(stx, sty)))) | (dx * (stp - stx) >= 0.0)
+		if ((brackt & ((stp <= std::min(stx, sty) ) | (stp >= std::max(stx, sty)))) | (dx * (stp - stx) >= Scalar(0))
 		| (stpmax < stpmin)) {
 			return;
 		}
 
-		Scalar sgnd = dp * (dx / fabs(dx));
+		Scalar sgnd = dp * (dx / std::abs(dx));
 
 		Scalar stpf = 0;
 		Scalar stpc = 0;
@@ -199,9 +217,9 @@ public:
 		if (fp > fx) {
 			info = 1;
 			bound = true;
-			Scalar theta = 3. * (fx - fp) / (stp - stx) + dx + dp;
+			Scalar theta = Scalar(3) * (fx - fp) / (stp - stx) + dx + dp;
 			Scalar s = std::max(theta, std::max(dx, dp));
-			Scalar gamma = s * sqrt((theta / s) * (theta / s) - (dx / s) * (dp / s));
+			Scalar gamma = s * std::sqrt((theta / s) * (theta / s) - (dx / s) * (dp / s));
 			if (stp < stx)
 				gamma = -gamma;
 
@@ -209,19 +227,19 @@ public:
 			Scalar q = ((gamma - dx) + gamma) + dp;
 			Scalar r = p / q;
 			stpc = stx + r * (stp - stx);
-			stpq = stx + ((dx / ((fx - fp) / (stp - stx) + dx)) / 2.) * (stp - stx);
-			if (fabs(stpc - stx) < fabs(stpq - stx))
+			stpq = stx + ((dx / ((fx - fp) / (stp - stx) + dx)) / Scalar(2)) * (stp - stx);
+			if (std::abs(stpc - stx) < std::abs(stpq - stx))
 				stpf = stpc;
 			else
 				stpf = stpc + (stpq - stpc) / 2;
 
 			brackt = true;
-		} else if (sgnd < 0.0) {
+		} else if (sgnd < Scalar(0)) {
 			info = 2;
 			bound = false;
 			Scalar theta = 3 * (fx - fp) / (stp - stx) + dx + dp;
 			Scalar s = std::max(theta, std::max(dx, dp));
-			Scalar gamma = s * sqrt((theta / s) * (theta / s)  - (dx / s) * (dp / s));
+			Scalar gamma = s * std::sqrt((theta / s) * (theta / s)  - (dx / s) * (dp / s));
 			if (stp > stx)
 				gamma = -gamma;
 
@@ -230,25 +248,25 @@ public:
 			Scalar r = p / q;
 			stpc = stp + r * (stx - stp);
 			stpq = stp + (dp / (dp - dx)) * (stx - stp);
-			if (fabs(stpc - stp) > fabs(stpq - stp))
+			if (std::abs(stpc - stp) > std::abs(stpq - stp))
 				stpf = stpc;
 			else
 				stpf = stpq;
 
 			brackt = true;
-		} else if (fabs(dp) < fabs(dx)) {
+		} else if (std::abs(dp) < std::abs(dx)) {
 			info = 3;
 			bound = 1;
 			Scalar theta = 3 * (fx - fp) / (stp - stx) + dx + dp;
 			Scalar s = std::max(theta, std::max( dx, dp));
-			Scalar gamma = s * sqrt(std::max(static_cast<Scalar>(0.), (theta / s) * (theta / s) - (dx / s) * (dp / s)));
+			Scalar gamma = s * std::sqrt(std::max(static_cast<Scalar>(0.), (theta / s) * (theta / s) - (dx / s) * (dp / s)));
 			if (stp > stx)
 				gamma = -gamma;
 
 			Scalar p = (gamma - dp) + theta;
 			Scalar q = (gamma + (dx - dp)) + gamma;
 			Scalar r = p / q;
-			if ((r < 0.0) & (gamma != 0.0)) {
+			if ((r < Scalar(0)) & (gamma != Scalar(0))) {
 				stpc = stp + r * (stx - stp);
 			} else if (stp > stx) {
 				stpc = stpmax;
@@ -257,13 +275,13 @@ public:
 			}
 			stpq = stp + (dp / (dp - dx)) * (stx - stp);
 			if (brackt) {
-				if (fabs(stp - stpc) < fabs(stp - stpq)) {
+				if (std::abs(stp - stpc) < std::abs(stp - stpq)) {
 					stpf = stpc;
 				} else {
 					stpf = stpq;
 				}
 			} else {
-				if (fabs(stp - stpc) > fabs(stp - stpq)) {
+				if (std::abs(stp - stpc) > std::abs(stp - stpq)) {
 					stpf = stpc;
 				} else {
 					stpf = stpq;
@@ -275,7 +293,7 @@ public:
 			if (brackt) {
 				Scalar theta = 3 * (fp - fy) / (sty - stp) + dy + dp;
 				Scalar s = std::max(theta, std::max(dy, dp));
-				Scalar gamma = s * sqrt((theta / s) * (theta / s) - (dy / s) * (dp / s));
+				Scalar gamma = s * std::sqrt((theta / s) * (theta / s) - (dy / s) * (dp / s));
 				if (stp > sty)
 					gamma = -gamma;
 
@@ -296,7 +314,7 @@ public:
 			fy = fp;
 			dy = dp;
 		} else {
-			if (sgnd < 0.0) {
+			if (sgnd < Scalar(0)) {
 				sty = stx;
 				fy = fx;
 				dy = dx;
@@ -27,8 +27,9 @@
 namespace mcl {
 namespace optlib {
 
-template<typename Scalar, int DIM>
-class Newton : public Minimizer<Scalar,DIM> {
+// LS = line search policy (see LineSearch.hpp)
+template<typename Scalar, int DIM, template<typename,int> class LS = LineSearch>
+class Newton : public MinimizerImpl<Newton<Scalar,DIM,LS>,Scalar,DIM> {
 private:
 	typedef Eigen::Matrix<Scalar,DIM,1> VectorX;
 	typedef Eigen::Matrix<Scalar,DIM,DIM> MatrixX;
@@ -38,39 +39,64 @@ public:
 		this->m_settings.max_iters = 20;
 	}
 
-	int minimize(Problem<Scalar,DIM> &problem, VectorX &x){
+protected:
+	friend class MinimizerImpl<Newton,Scalar,DIM>;
 
-		VectorX grad, delta_x, x_last;
-		if( DIM  == Eigen::Dynamic ){
-			int dim = x.rows();
-			x_last.resize(dim);
-			grad.resize(dim);
-			delta_x.resize(dim);
-		}
+	template<typename P>
+	int solve_impl(P &problem, VectorX &x){
+
+		// Reuse buffers from the last call if possible
+		m_ws.resize(x.rows());
+		VectorX &grad = m_ws.grad;
+		VectorX &delta_x = m_ws.delta_x;
+		VectorX &x_last = m_ws.x_last;
 
 		int verbose = this->m_settings.verbose;
 		int max_iters = this->m_settings.max_iters;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
+
+		// Afterwards the gradient is updated by the line search
+		Scalar fx = problem.gradient(x,grad);
+		this->begin_solve(x, fx);
+
 		int iter = 0;
 		for( ; iter < max_iters; ++iter ){
 
-			problem.gradient(x,grad);
 			problem.solve_hessian(x,grad,delta_x);
 
-			Scalar rate = this->linesearch(x, delta_x, problem, 1.0);
+			Scalar rate = this->template linesearch< LS<Scalar,DIM> >(x, delta_x, problem, Scalar(1), fx, grad);
 
 			if( rate <= 0 ){
+				if( this->stop_on_deadline(x, fx) ){ break; }
 				if( verbose > 0 ){ printf("Newton::minimize: Failure in linesearch\n"); }
+				report.iters = iter;
+				report.termination = Termination::LineSearchFailure;
 				return Minimizer<Scalar,DIM>::FAILURE;
 			}
 
 			x_last = x;
 			x += rate * delta_x;
-			if( problem.converged(x_last,x,grad) ){ break; }
+			if( problem.converged(x_last,x,grad) ){ report.termination = Termination::Converged; }
+			if( this->end_iteration(iter, x_last, x, fx, grad) ){ break; }
 		}
 
+		report.iters = iter;
 		return iter;
 	}
 
+private:
+	// Buffers that persist between calls to minimize
+	struct Workspace {
+		VectorX grad, delta_x, x_last;
+		void resize(int dim){
+			if( grad.rows() == dim ){ return; }
+			grad = VectorX::Zero(dim);
+			delta_x = VectorX::Zero(dim);
+			x_last = VectorX::Zero(dim);
+		}
+	} m_ws;
+
 };
 
 } // ns optlib
@@ -0,0 +1,175 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_NEWTONCG_H
+#define MCL_NEWTONCG_H
+
+#include "Minimizer.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Truncated Newton's (Nocedal & Wright, Algorithm 7.1).
+// The Newton step is found inexactly with conjugate gradient, using
+// only Problem::hessian_vec, so the hessian is never stored.
+// The CG tolerance follows the Eisenstat-Walker forcing sequence,
+// loose far from the solution and tighter as the gradient shrinks.
+// LS = line search policy (see LineSearch.hpp)
+//
+template<typename Scalar, int DIM, template<typename,int> class LS = LineSearch>
+class NewtonCG : public MinimizerImpl<NewtonCG<Scalar,DIM,LS>,Scalar,DIM> {
+private:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+public:
+	int max_cg_iters; // max CG iterations per step, 0 = dimension of the problem
+	Scalar eta_max; // upper bound on the forcing term (0<eta_max<1)
+
+	NewtonCG() : max_cg_iters(0), eta_max(0.9) {
+		this->m_settings.max_iters = 100;
+	}
+
+protected:
+	friend class MinimizerImpl<NewtonCG,Scalar,DIM>;
+
+	template<typename P>
+	int solve_impl(P &problem, VecX &x){
+
+		// Reuse buffers from the last call if possible
+		m_ws.resize(x.rows());
+		VecX &grad = m_ws.grad;
+		VecX &dx = m_ws.dx;
+		VecX &x_last = m_ws.x_last;
+
+		int verbose = this->m_settings.verbose;
+		int max_iters = this->m_settings.max_iters;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
+
+		// Afterwards the gradient is updated by the line search
+		Scalar fx = problem.gradient(x,grad);
+		this->begin_solve(x, fx);
+		Scalar grad_norm = grad.norm();
+		Scalar eta = 0.5; // forcing term
+
+		int iter = 0;
+		for( ; iter < max_iters; ++iter ){
+
+			report.cg_iters += solve_cg(problem, x, grad, eta*grad_norm, dx);
+
+			Scalar rate = this->template linesearch< LS<Scalar,DIM> >(x, dx, problem, Scalar(1), fx, grad);
+
+			if( rate <= 0 ){
+				if( this->stop_on_deadline(x, fx) ){ break; }
+				if( verbose > 0 ){ printf("NewtonCG::minimize: Failure in linesearch\n"); }
+				report.iters = iter;
+				report.termination = Termination::LineSearchFailure;
+				return Minimizer<Scalar,DIM>::FAILURE;
+			}
+
+			x_last = x;
+			x += rate * dx;
+
+			// A zero gradient is stationary even if converged() is not gradient
+			// based, and would make the forcing term below 0/0.
+			Scalar grad_norm_new = grad.norm();
+			if( problem.converged(x_last,x,grad) || !(grad_norm_new > 0) ){ report.termination = Termination::Converged; }
+			if( this->end_iteration(iter, x_last, x, fx, grad) ){ break; }
+
+			// Eisenstat-Walker choice 2 (gamma = 0.9, alpha = 2) with safeguard
+			Scalar eta_prev = eta;
+			Scalar ratio = grad_norm_new / grad_norm;
+			eta = Scalar(0.9)*ratio*ratio;
+			Scalar eta_safe = Scalar(0.9)*eta_prev*eta_prev;
+			if( eta_safe > Scalar(0.1) ){ eta = std::max(eta, eta_safe); }
+			eta = std::min(eta, eta_max);
+			grad_norm = grad_norm_new;
+		}
+
+		report.iters = iter;
+		return iter;
+	}
+
+	// Solves H dx = -grad with CG until |H dx + grad| <= tol.
+	// Stops early if a direction of non-positive curvature is found,
+	// returning the step so far (or steepest descent on the first iteration).
+	// Returns the number of CG iterations.
+	template<typename P>
+	int solve_cg(P &problem, const VecX &x, const VecX &grad, Scalar tol, VecX &dx){
+		const int dim = x.rows();
+		const int max_cg = max_cg_iters > 0 ? max_cg_iters : dim;
+		const Scalar eps = std::numeric_limits<Scalar>::epsilon();
+		VecX &r = m_ws.r;
+		VecX &d = m_ws.d;
+		VecX &Hd = m_ws.Hd;
+
+		dx.setZero();
+		r = -grad;
+		d = r;
+		Scalar rr = r.squaredNorm();
+
+		int j = 0;
+		for( ; j < max_cg; ++j ){
+			problem.hessian_vec(x, d, Hd);
+			Scalar dHd = d.dot(Hd);
+
+			// Negative curvature
+			if( dHd <= eps*d.squaredNorm() ){
+				if( j == 0 ){ dx = -grad; }
+				break;
+			}
+
+			Scalar alpha = rr / dHd;
+			dx.noalias() += alpha*d;
+			r.noalias() -= alpha*Hd;
+			Scalar rr_new = r.squaredNorm();
+			if( std::sqrt(rr_new) <= tol ){ ++j; break; }
+			d = r + (rr_new/rr)*d;
+			rr = rr_new;
+		}
+
+		return j;
+	}
+
+private:
+	// Buffers that persist between calls to minimize
+	struct Workspace {
+		VecX grad, dx, x_last;
+		VecX r, d, Hd; // used by solve_cg
+		void resize(int dim){
+			if( grad.rows() == dim ){ return; }
+			grad = VecX::Zero(dim);
+			dx = VecX::Zero(dim);
+			x_last = VecX::Zero(dim);
+			r = VecX::Zero(dim);
+			d = VecX::Zero(dim);
+			Hd = VecX::Zero(dim);
+		}
+	} m_ws;
+
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
@@ -27,8 +27,11 @@
 namespace mcl {
 namespace optlib {
 
-template<typename Scalar, int DIM>
-class NonLinearCG : public Minimizer<Scalar,DIM> {
+// Nonlinear conjugate gradient. The beta update is chosen with Settings::cg_method,
+// and a preconditioner can be given with Problem::precondition.
+// LS = line search policy (see LineSearch.hpp)
+template<typename Scalar, int DIM, template<typename,int> class LS = LineSearch>
+class NonLinearCG : public MinimizerImpl<NonLinearCG<Scalar,DIM,LS>,Scalar,DIM> {
 private:
 	typedef Eigen::Matrix<Scalar,DIM,1> VectorX;
 	typedef Eigen::Matrix<Scalar,DIM,DIM> MatrixX;
@@ -36,48 +39,128 @@ private:
 public:
 	NonLinearCG() {
 		this->m_settings.max_iters = 100;
+		this->m_settings.ls_curvature = 0.1; // conjugacy needs a more exact line search
 	}
 
-	int minimize(Problem<Scalar,DIM> &problem, VectorX &x){
+protected:
+	friend class MinimizerImpl<NonLinearCG,Scalar,DIM>;
 
-		VectorX grad, grad_old, p, x_last;
-		if( DIM == Eigen::Dynamic ){
-			int dim = x.rows();
-			x_last.setZero(dim);
-			grad.resize(dim);
-			grad_old.resize(dim);
-			p.resize(dim);
-		}
+	template<typename P>
+	int solve_impl(P &problem, VectorX &x){
+
+		// Reuse buffers from the last call if possible
+		m_ws.resize(x.rows());
+		VectorX &grad = m_ws.grad;
+		VectorX &grad_old = m_ws.grad_old;
+		VectorX &z = m_ws.z; // preconditioned gradient
+		VectorX &z_old = m_ws.z_old;
+		VectorX &p = m_ws.p;
+		VectorX &x_last = m_ws.x_last;
 
 		int verbose = this->m_settings.verbose;
 		int max_iters = this->m_settings.max_iters;
+		CGMethod method = this->m_settings.cg_method;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
+
+		// Afterwards the gradient is updated by the line search
+		Scalar fx = problem.gradient(x, grad);
+		this->begin_solve(x, fx);
+
 		int iter=0;
+		int since_restart=0;
 		for( ; iter<max_iters; ++iter ){
 
-			problem.gradient(x, grad);
-
-			if( iter==0 ){ p = -grad; }
-			else {
-				Scalar beta = grad.dot(grad) / (grad_old.dot(grad_old));
-				p = -grad + beta*p;
+			// Fall back to no preconditioning if M^-1 is not positive definite
+			if( !problem.precondition(x, grad, z) || !(grad.dot(z) > 0) ){ z = grad; }
+
+			// Restart with steepest descent every n iterations, if successive
+			// gradients are far from orthogonal (Powell), or if p is not a descent
+			// direction (e.g. rounding in float has lost conjugacy).
+			bool restart = iter==0 || since_restart >= x.rows() ||
+				std::abs(grad.dot(z_old)) >= Scalar(0.2)*grad.dot(z);
+			if( !restart ){
+				p = -z + beta(method, grad, grad_old, z, z_old, p)*p;
+				restart = !(p.dot(grad) < 0);
+			}
+			if( restart ){
+				p = -z;
+				since_restart = 0;
 			}
+			since_restart++;
 
-			Scalar rate = this->linesearch(x, p, problem, 1.0);
+			grad_old = grad;
+			z_old = z;
+			Scalar rate = this->template linesearch< LS<Scalar,DIM> >(x, p, problem, Scalar(1), fx, grad);
 
 			if( rate <= 0 ){
+				if( this->stop_on_deadline(x, fx) ){ break; }
 				if( verbose > 0 ){ printf("NonLinearCG::minimize: Failure in linesearch\n"); }
+				report.iters = iter;
+				report.termination = Termination::LineSearchFailure;
 				return Minimizer<Scalar,DIM>::FAILURE;
 			}
 
 			x_last = x;
 			x += rate*p;
-			grad_old = grad;
 
-			if( problem.converged(x_last,x,grad) ){ break; }
+			if( problem.converged(x_last,x,grad) ){ report.termination = Termination::Converged; }
+			if( this->end_iteration(iter, x_last, x, fx, grad) ){ break; }
 		}
+		report.iters = iter;
 		return iter;
 	} // end minimize
 
+private:
+	// Conjugate direction update for the previous direction p, with y = grad - grad_old.
+	// Returns 0 (steepest descent) if the denominator is not positive.
+	static inline Scalar beta(CGMethod method, const VectorX &grad, const VectorX &grad_old,
+		const VectorX &z, const VectorX &z_old, const VectorX &p){
+
+		Scalar gz_old = grad_old.dot(z_old);
+		Scalar py = p.dot(grad) - p.dot(grad_old);
+		Scalar b = 0;
+		switch( method ){
+			case CGMethod::FletcherReeves: {
+				if( gz_old > 0 ){ b = grad.dot(z) / gz_old; }
+			} break;
+			case CGMethod::PolakRibierePlus: {
+				if( gz_old > 0 ){ b = std::max( Scalar(0), (z.dot(grad) - z.dot(grad_old)) / gz_old ); }
+			} break;
+			case CGMethod::HestenesStiefel: {
+				if( py > 0 ){ b = (z.dot(grad) - z.dot(grad_old)) / py; }
+			} break;
+			case CGMethod::DaiYuan: {
+				if( py > 0 ){ b = grad.dot(z) / py; }
+			} break;
+			case CGMethod::HagerZhang: {
+				// Hager & Zhang 2006/2013, with M^-1 y = z - z_old and the lower bound eta = 0.01
+				if( py > 0 ){
+					Scalar yz = z.dot(grad) - z.dot(grad_old);
+					Scalar yMy = yz - (z_old.dot(grad) - z_old.dot(grad_old));
+					b = ( yz - Scalar(2)*yMy*p.dot(grad)/py ) / py;
+					Scalar eta = Scalar(-1) / ( p.norm() * std::min( Scalar(0.01), std::sqrt(gz_old) ) );
+					b = std::max( b, eta );
+				}
+			} break;
+		}
+		return std::isfinite(b) ? b : Scalar(0);
+	}
+
+	// Buffers that persist between calls to minimize
+	struct Workspace {
+		VectorX grad, grad_old, z, z_old, p, x_last;
+		void resize(int dim){
+			if( grad.rows() == dim ){ return; }
+			grad = VectorX::Zero(dim);
+			grad_old = VectorX::Zero(dim);
+			z = VectorX::Zero(dim);
+			z_old = VectorX::Zero(dim);
+			p = VectorX::Zero(dim);
+			x_last = VectorX::Zero(dim);
+		}
+	} m_ws;
+
 };
 
 } // ns optlib
@@ -0,0 +1,151 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_PARALLELBACKTRACKING_H
+#define MCL_PARALLELBACKTRACKING_H
+
+#include "Problem.hpp"
+#include "LineSearchState.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Backtracking Armijo that evaluates several trial steps at once. The steps are
+// the ladder of Backtracking, alpha0 * 0.7^k, taken settings.ls_threads at a time
+// and evaluated concurrently. The first step of the ladder with sufficient decrease
+// is accepted, so the result is the same as Backtracking, with up to ls_threads-1
+// extra value calls per pass. Only worth it if value(x) is expensive.
+//
+// Problem::value must be safe to call concurrently (ReportProblem is). The thread
+// pool and trial buffers are kept in the solver's LineSearchState, so every solver
+// owns a pool of settings.ls_threads threads. Solvers run concurrently (e.g. by
+// ParallelSolve) each have their own, which oversubscribes the cores. With the
+// default ls_threads = 0, the trial steps are evaluated serially when called
+// from a parallel loop (see ThreadPool::in_parallel), and no pool is created.
+//
+template<typename Scalar, int DIM>
+class ParallelBacktracking {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+
+	// fx and grad are f(x) and its gradient on input, and f(x+alpha*p)
+	// and its gradient at the returned alpha on output.
+	// x_trial and grad_trial are preallocated buffers (same size as x)
+	// iters = number of trial steps on output, including the speculative ones
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		(void)(grad_trial);
+		iters = 0;
+		const int verbose = settings.verbose;
+		const int max_iters = settings.ls_max_iters;
+		const Scalar decrease = settings.ls_decrease;
+
+		// First things first, check descent norm
+		const Scalar t_eps = std::numeric_limits<Scalar>::epsilon();
+		if( p.norm() <= t_eps ){
+			x_trial = x + decrease*p;
+			fx = problem.gradient(x_trial, grad);
+			return decrease;
+		}
+
+		const int n = workspace(state, settings.ls_threads, x.rows());
+		const Scalar tau = 0.7;
+		Scalar alpha = alpha0;
+		Scalar fx0 = fx;
+		Scalar gtp = grad.dot(p);
+
+		int accepted = -1;
+		int iter = 0;
+		while( iter < max_iters && accepted < 0 ){
+			if( state.deadline.expired() ){ iters = iter; return -1; } // out of time
+
+			// Next n steps of the ladder, same products as the serial alpha *= tau
+			const int n_trials = std::min( n, max_iters-iter );
+			for( int k=0; k<n_trials; ++k ){
+				state.pool_alpha[k] = alpha;
+				alpha *= tau;
+			}
+
+			// One step at a time without a pool, same as Backtracking
+			if( !state.pool ){
+				for( int k=0; k<n_trials; ++k ){
+					x_trial = x + state.pool_alpha[k]*p;
+					state.pool_fx[k] = problem.value(x_trial);
+				}
+			}
+			else {
+				state.pool->parallel_for( n_trials, [&](int k, int thread){
+					VecX &xk = state.pool_x[thread];
+					xk = x + state.pool_alpha[k]*p;
+					state.pool_fx[k] = problem.value(xk);
+				});
+			}
+
+			for( int k=0; k<n_trials && accepted < 0; ++k ){
+				Scalar fx0_fxa = fx0 + state.pool_alpha[k]*decrease*gtp; // Armijo condition I
+				if( state.pool_fx[k] <= fx0_fxa ){ accepted = k; } // sufficient decrease
+			}
+			iter += n_trials;
+		}
+		iters = iter;
+
+		if( accepted < 0 ){
+			if( verbose > 0 ){ printf("ParallelBacktracking::search Error: Reached max_iters\n"); }
+			return -1;
+		}
+
+		alpha = state.pool_alpha[accepted];
+		x_trial = x + alpha*p;
+		fx = problem.gradient(x_trial, grad);
+		return alpha;
+	}
+
+private:
+	// Creates the pool (if needed) and sizes the buffers of state,
+	// returns the number of trial steps evaluated at once
+	static inline int workspace(LineSearchState<Scalar,DIM> &state, int threads, int dim){
+		// Serial if called from e.g. ParallelSolve, which already uses the cores
+		if( threads <= 0 && ThreadPool::in_parallel() ){ threads = 1; }
+		if( threads == 1 ){ state.pool.reset(); }
+		else if( !state.pool || (threads > 0 && state.pool->size() != threads) ){
+			state.pool.reset( new ThreadPool(threads) );
+		}
+
+		const int n = state.pool ? state.pool->size() : 1;
+		const int n_x = state.pool ? n : 0;
+		if( int(state.pool_alpha.size()) != n || int(state.pool_x.size()) != n_x ||
+			(n_x > 0 && state.pool_x[0].rows() != dim) ){
+			state.pool_x.assign( n_x, VecX::Zero(dim) );
+			state.pool_alpha.assign( n, Scalar(0) );
+			state.pool_fx.assign( n, Scalar(0) );
+		}
+		return n;
+	}
+
+}; // end class ParallelBacktracking
+
+} // ns optlib
+} // ns mcl
+
+#endif
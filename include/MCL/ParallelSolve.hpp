@@ -0,0 +1,156 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_PARALLELSOLVE_H
+#define MCL_PARALLELSOLVE_H
+
+#include "Minimizer.hpp"
+#include "ThreadPool.hpp"
+#include <mutex>
+#include <utility>
+
+namespace mcl {
+namespace optlib {
+
+//
+// Solves many independent problems concurrently. Every thread gets its own
+// clone of the solver (Minimizer::clone), so settings and buffers are never
+// shared, and the problems are pulled from per-thread queues. A thread that
+// runs out of problems steals half of the remaining problems from another
+// queue, which balances the load when iteration counts vary widely.
+// Each problem must only be used once in the list, but problems do
+// not need to be thread safe. The solver's m_callback is copied into every
+// clone and called concurrently, so it must be thread safe (or empty).
+//
+template<typename Scalar, int DIM>
+class ParallelSolve {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef std::pair< Problem<Scalar,DIM>*, VecX* > Task;
+
+	struct Settings {
+		int threads; // 0 = hardware concurrency
+		Settings() : threads(0) {}
+	} m_settings;
+
+	// Results of the last call to solve, for each problem
+	std::vector<int> m_iters; // return value of minimize (iterations or FAILURE)
+	std::vector<SolveReport> m_reports;
+	int m_steals; // number of times work was stolen
+
+	ParallelSolve() : m_steals(0) {}
+
+	// Minimizes every (problem, x) pair with a copy of solver, which must
+	// implement Minimizer::clone (e.g. derive from MinimizerImpl).
+	// Returns the number of problems that converged.
+	int solve(const Minimizer<Scalar,DIM> &solver, const std::vector<Task> &tasks){
+		const int n = tasks.size();
+		m_iters.assign(n, 0);
+		m_reports.assign(n, SolveReport());
+		m_steals = 0;
+		if( n == 0 ){ return 0; }
+
+		const int threads = m_settings.threads;
+		if( !m_pool || (threads > 0 && m_pool->size() != threads) ){
+			m_pool.reset( new ThreadPool(threads) );
+		}
+		const int n_threads = m_pool->size();
+
+		// Per-thread copies of the solver
+		m_solvers.resize(n_threads);
+		for( int t=0; t<n_threads; ++t ){ m_solvers[t] = solver.clone(); }
+
+		// Split the problems into contiguous queues
+		m_queues.reset( new Queue[n_threads] );
+		for( int t=0; t<n_threads; ++t ){
+			m_queues[t].begin = (n*t) / n_threads;
+			m_queues[t].end = (n*(t+1)) / n_threads;
+		}
+
+		std::mutex steal_lock;
+		m_pool->parallel_for(n_threads, [&](int i, int thread){
+			(void)(i);
+			Minimizer<Scalar,DIM> &s = *m_solvers[thread];
+			int task = 0, steals = 0;
+			while( pop(thread, task) || steal(thread, n_threads, task, steals) ){
+				m_iters[task] = s.minimize( *tasks[task].first, *tasks[task].second );
+				m_reports[task] = s.m_report;
+			}
+			std::lock_guard<std::mutex> guard(steal_lock);
+			m_steals += steals;
+		});
+
+		int n_converged = 0;
+		for( int i=0; i<n; ++i ){ n_converged += m_reports[i].termination == Termination::Converged; }
+		return n_converged;
+	}
+
+private:
+	// Remaining problems [begin,end) of a thread. The owner takes from
+	// the front and thieves take from the back.
+	struct Queue {
+		std::mutex lock;
+		int begin, end;
+		Queue() : begin(0), end(0) {}
+	};
+
+	std::unique_ptr<ThreadPool> m_pool;
+	std::unique_ptr<Queue[]> m_queues;
+	std::vector< std::unique_ptr< Minimizer<Scalar,DIM> > > m_solvers;
+
+	bool pop(int thread, int &task){
+		Queue &q = m_queues[thread];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if( q.begin >= q.end ){ return false; }
+		task = q.begin++;
+		return true;
+	}
+
+	// Moves the back half of another queue to this thread's queue
+	bool steal(int thread, int n_threads, int &task, int &steals){
+		for( int k=1; k<n_threads; ++k ){
+			Queue &victim = m_queues[(thread+k) % n_threads];
+			int begin = 0, end = 0;
+			{
+				std::lock_guard<std::mutex> guard(victim.lock);
+				int n_left = victim.end - victim.begin;
+				if( n_left <= 0 ){ continue; }
+				end = victim.end;
+				begin = end - (n_left+1)/2;
+				victim.end = begin;
+			}
+			Queue &q = m_queues[thread];
+			std::lock_guard<std::mutex> guard(q.lock);
+			q.begin = begin + 1;
+			q.end = end;
+			task = begin;
+			steals++;
+			return true;
+		}
+		return false;
+	}
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
@@ -25,7 +25,10 @@
 #include <iostream>
 #endif
 
+#include "FiniteDiff.hpp"
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <vector>
 
 namespace mcl {
 namespace optlib {
@@ -35,19 +38,40 @@ class Problem {
 private:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+	typedef Eigen::SparseMatrix<Scalar> SparseMat;
+
+	// Cached sparse hessian and factorization, see is_sparse()
+	int m_sparse_state; // -1 = unchecked, 0 = dense, 1 = sparse
+	SparseMat m_sparse_hess;
+	Eigen::SimplicialLDLT<SparseMat> m_sparse_solver;
+
+	// Set by the default gradient, so that finiteHessian can use values instead
+	bool m_fd_gradient;
+
+	// Hessian at x computed by hessian_newton (or sparse_hessian_newton) while
+	// it calls solve_hessian, so that the default solve_hessian can use it
+	const MatX *m_newton_hess;
+	const SparseMat *m_newton_sparse_hess;
 
 public:
+	FiniteDiff<Scalar,DIM> m_fd; // used by finiteGradient and finiteHessian
+
+	Problem() : m_sparse_state(-1), m_fd_gradient(false), m_newton_hess(nullptr), m_newton_sparse_hess(nullptr) {}
+	virtual ~Problem(){}
+
 	// Returns true if the solver has converged
 	// x0 is the result of the previous iteration
 	// x1 is the result at the current iteration
 	// grad is the gradient at the last iteration
 	virtual bool converged(const VecX &x0, const VecX &x1, const VecX &grad) = 0;
 
-	// Compute just the value
+	// Compute just the value. Must be safe to call concurrently
+	// if used with LSMethod::ParallelBacktracking.
 	virtual Scalar value(const VecX &x) = 0;
 
 	// Compute the objective value and the gradient
 	virtual Scalar gradient(const VecX &x, VecX &grad){
+		m_fd_gradient = true;
 		finiteGradient(x, grad);
 		return value(x);
 	}
@@ -57,15 +81,117 @@ public:
 		finiteHessian(x, hessian);
 	}
 
+	// Sparsity pattern of the hessian. Return true and set the nonzeros
+	// of pattern to use sparse hessians in Newton's and TrustRegion.
+	// It is called only once: the symbolic factorization of the pattern
+	// is reused by every solve_hessian, so sparse_hessian must always
+	// return a matrix with the same nonzeros. Values are ignored.
+	virtual bool hessian_pattern(SparseMat &pattern){
+		(void)(pattern);
+		return false;
+	}
+
+	// Compute sparse hessian, only used if hessian_pattern returns true.
+	// Default uses finite differences (finiteSparseHessian), which needs
+	// the pattern to contain both triangles.
+	virtual void sparse_hessian(const VecX &x, SparseMat &hessian){
+		finiteSparseHessian(x, hessian);
+	}
+
+	// Box constraints lower <= x <= upper. Return true and set lower and upper
+	// (same size as x, +/- infinity if unbounded) to use them in LBFGSB.
+	// The other solvers ignore the bounds.
+	virtual bool bounds(VecX &lower, VecX &upper){
+		(void)(lower); (void)(upper);
+		return false;
+	}
+
+	// Preconditioner of NonLinearCG. Return true and set z = M^-1 grad,
+	// with M symmetric positive definite, e.g. z = grad.cwiseQuotient(diag)
+	// for a diagonal preconditioner. The other solvers ignore it.
+	virtual bool precondition(const VecX &x, const VecX &grad, VecX &z){
+		(void)(x); (void)(grad); (void)(z);
+		return false;
+	}
+
+	// Returns true if the problem uses sparse hessians (see hessian_pattern).
+	// The pattern is fetched and analyzed on the first call.
+	virtual bool is_sparse(){
+		if( m_sparse_state < 0 ){
+			m_sparse_state = 0;
+			if( hessian_pattern(m_sparse_hess) ){
+				m_sparse_hess.makeCompressed();
+				m_sparse_solver.analyzePattern(m_sparse_hess);
+				m_fd.color(m_sparse_hess);
+				m_sparse_state = 1;
+			}
+		}
+		return m_sparse_state == 1;
+	}
+
+	// Compute the hessian-vector product Hv = H(x)*v (used by NewtonCG).
+	// Default uses finite differences of the gradient, which
+	// costs two gradients and needs no hessian storage.
+	virtual void hessian_vec(const VecX &x, const VecX &v, VecX &Hv){
+		m_fd.hessian_vec( [this](const VecX &xx, VecX &g){ this->gradient(xx,g); }, x, v, Hv );
+	}
+
 	// Solve dx = H^-1 -g (used by Newton's)
 	virtual void solve_hessian(const VecX &x, const VecX &grad, VecX &dx){
+
+		// Called by hessian_newton, which has already computed the hessian
+		if( m_newton_hess ){
+			solve_dense(*m_newton_hess, grad, dx);
+			return;
+		}
+		if( m_newton_sparse_hess ){
+			solve_sparse(*m_newton_sparse_hess, grad, dx);
+			return;
+		}
+
+		// Sparse hessians only redo the numeric factorization
+		if( is_sparse() ){
+			sparse_hessian(x, m_sparse_hess);
+			solve_sparse(m_sparse_hess, grad, dx);
+			return;
+		}
+
 		MatX hess;
 		if( DIM  == Eigen::Dynamic ){
 			int dim = x.rows();
 			hess = MatX::Zero(dim,dim);
 		}
 		hessian(x,hess); // hessian at x_n
+		solve_dense(hess, grad, dx);
+	}
 
+	// Compute the hessian and the Newton step dx = H^-1 -g together (used by TrustRegion).
+	// Default calls hessian, then solve_hessian, which uses that hessian instead of
+	// evaluating it again unless overridden. Override to share work between the two.
+	virtual void hessian_newton(const VecX &x, const VecX &grad, MatX &hess, VecX &dx){
+		hessian(x,hess);
+		m_newton_hess = &hess;
+		solve_hessian(x,grad,dx);
+		m_newton_hess = nullptr;
+	}
+
+	// Same as above for sparse hessians, only used if hessian_pattern returns true.
+	virtual void sparse_hessian_newton(const VecX &x, const VecX &grad, SparseMat &hess, VecX &dx){
+		sparse_hessian(x,hess);
+		m_newton_sparse_hess = &hess;
+		solve_hessian(x,grad,dx);
+		m_newton_sparse_hess = nullptr;
+	}
+
+	// Solves dx = H^-1 -g with the pattern analyzed by is_sparse()
+	inline void solve_sparse(const SparseMat &hess, const VecX &grad, VecX &dx){
+		m_sparse_solver.factorize(hess);
+		if( m_sparse_solver.info() != Eigen::Success ){ dx = -grad; } // fall back to gradient descent
+		else{ dx = m_sparse_solver.solve(-grad); }
+	}
+
+	// Solves dx = H^-1 -g with a dense factorization
+	static inline void solve_dense(const MatX &hess, const VecX &grad, VecX &dx){
 		// Going with with high-accurate, low requirements as default factorization for lin-solve
 		// Copied from https://eigen.tuxfamily.org/dox/group__TutorialLinearAlgebra.html
 		//	Method			Requirements	Spd (sm)	Spd (lg)	Accuracy
@@ -84,49 +210,37 @@ public:
 		}
 	}
 
-	// Gradient with finite differences
+	// Gradient with finite differences, see FiniteDiff.hpp.
+	// Set m_fd.m_settings.thread_safe if value(x) can be called
+	// concurrently to evaluate the partials in parallel.
 	inline void finiteGradient(const VecX &x, VecX &grad){
-		const int accuracy = 0; // accuracy can be 0, 1, 2, 3
-		const Scalar eps = 2.2204e-6;
-		const std::vector< std::vector<Scalar> > coeff =
-		{ {1, -1}, {1, -8, 8, -1}, {-1, 9, -45, 45, -9, 1}, {3, -32, 168, -672, 672, -168, 32, -3} };
-		const std::vector< std::vector<Scalar> > coeff2 =
-		{ {1, -1}, {-2, -1, 1, 2}, {-3, -2, -1, 1, 2, 3}, {-4, -3, -2, -1, 1, 2, 3, 4} };
-		const std::vector<Scalar> dd = {2, 12, 60, 840};
-		int dim = x.rows();
-		if( grad.rows() != dim ){ grad = VecX::Zero(dim); }
-		else{ grad.setZero(); }
-		for(int d = 0; d < dim; ++d){
-			for (int s = 0; s < 2*(accuracy+1); ++s){
-				VecX xx = x.eval();
-				xx[d] += coeff2[accuracy][s]*eps;
-				grad[d] += coeff[accuracy][s]*value(xx);
-			}
-			grad[d] /= (dd[accuracy]* eps);
-		}
+		m_fd.gradient( [this](const VecX &xx){ return this->value(xx); }, x, grad );
 	} // end finite grad
 
-	// Hessian with finite differences
+	// Hessian with finite differences of the gradient, see FiniteDiff.hpp.
+	// If the gradient is the default (finite differences), second differences
+	// of the value are used instead, which takes half as many values.
 	inline void finiteHessian(const VecX &x, MatX &hess){
-		const Scalar eps = std::numeric_limits<Scalar>::epsilon()*10e7;
-		int dim = x.rows();
-		if( hess.rows() != dim || hess.cols() != dim ){ hess = MatX::Zero(dim,dim); }
-		for(int i = 0; i < dim; ++i){
-			for(int j = 0; j < dim; ++j){
-				VecX xx = x;
-				Scalar f4 = value(xx);
-				xx[i] += eps;
-				xx[j] += eps;
-				Scalar f1 = value(xx);
-				xx[j] -= eps;
-				Scalar f2 = value(xx);
-				xx[j] += eps;
-				xx[i] -= eps;
-				Scalar f3 = value(xx);
-				hess(i, j) = (f1 - f2 - f3 + f4) / (eps * eps);
-			}
+		if( m_fd_gradient ){
+			m_fd.hessian_value( [this](const VecX &xx){ return this->value(xx); }, x, hess );
+			return;
 		}
+		m_fd.hessian( [this](const VecX &xx, VecX &g){ this->gradient(xx,g); }, x, hess );
 	} // end finite hess
+
+	// Sparse hessian with finite differences, using a coloring
+	// of hessian_pattern to perturb many columns at once. Always uses
+	// the gradient, since a coloring already costs O(n) values per gradient.
+	inline void finiteSparseHessian(const VecX &x, SparseMat &hess){
+		if( !is_sparse() ){
+			throw std::runtime_error("Problem::finiteSparseHessian Error: hessian_pattern not given");
+		}
+		if( &hess != &m_sparse_hess && ( hess.rows() != m_sparse_hess.rows() ||
+			hess.nonZeros() != m_sparse_hess.nonZeros() || !hess.isCompressed() ) ){
+			hess = m_sparse_hess;
+		}
+		m_fd.sparse_hessian( [this](const VecX &xx, VecX &g){ this->gradient(xx,g); }, x, hess );
+	} // end finite sparse hess
 };
 
 }
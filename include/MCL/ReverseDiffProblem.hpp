@@ -0,0 +1,104 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_REVERSEDIFFPROBLEM_H
+#define MCL_REVERSEDIFFPROBLEM_H
+
+#include "Problem.hpp"
+#include "Tape.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Reverse-mode automatic differentiation for large problems (see Tape.hpp).
+// The energy is written once with ADVars:
+//
+//	class MyProblem : public ReverseDiffProblem<double,Eigen::Dynamic> {
+//		bool converged(const VecX &x0, const VecX &x1, const VecX &grad);
+//		Var energy(const VarVec &x);
+//	};
+//
+// and the gradient costs a small constant times the energy, independent of
+// the dimension. Hessians and hessian-vector products use the finite
+// difference defaults of Problem on the exact gradient.
+//
+// If m_replay is true, the tape recorded by the first evaluation is reused
+// for every x of the same size, so energy() is only called once. This is only
+// valid if the energy has no branches on the values of x (see ADTape).
+// Set m_replay = false or call rerecord() if the control flow changes.
+//
+template<typename Scalar, int DIM>
+class ReverseDiffProblem : public Problem<Scalar,DIM> {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef ADVar<Scalar> Var;
+	typedef std::vector<Var> VarVec;
+
+	bool m_replay; // reuse the recorded tape for new x
+	ADTape<Scalar> m_tape;
+
+	ReverseDiffProblem() : m_replay(false), m_rerecord(true) {}
+	virtual ~ReverseDiffProblem(){}
+
+	// The objective, recorded on m_tape
+	virtual Var energy(const VarVec &x) = 0;
+
+	// Compute just the value. Override with a plain Scalar
+	// version if the energy is often evaluated without gradients.
+	virtual Scalar value(const VecX &x){
+		evaluate(x);
+		return m_tape.value();
+	}
+
+	// Compute the objective value and the exact gradient
+	virtual Scalar gradient(const VecX &x, VecX &grad){
+		evaluate(x);
+		if( grad.rows() != x.rows() ){ grad = VecX::Zero(x.rows()); }
+		m_tape.gradient(grad);
+		return m_tape.value();
+	}
+
+	// Forces the next evaluation to call energy() again
+	void rerecord(){ m_rerecord = true; }
+
+protected:
+	VarVec m_x; // inputs on the tape
+	bool m_rerecord;
+
+	// Records or replays the tape at x
+	inline void evaluate(const VecX &x){
+		if( m_replay && !m_rerecord && m_tape.recorded(x.rows()) ){
+			m_tape.replay(x);
+			return;
+		}
+		m_tape.record(x, m_x);
+		m_tape.set_output( energy(m_x) );
+		m_rerecord = false;
+	}
+
+}; // end class ReverseDiffProblem
+
+} // ns optlib
+} // ns mcl
+
+#endif
@@ -0,0 +1,130 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_SETTINGS_H
+#define MCL_SETTINGS_H
+
+#include <chrono>
+
+namespace mcl {
+namespace optlib {
+
+// The different line search methods currently implemented
+enum class LSMethod {
+	None = 0, // use step length = 1, not recommended
+	MoreThuente, // TODO test this one for correctness
+	Backtracking, // basic backtracking with sufficient decrease
+	BacktrackingCubic, // backtracking with cubic interpolation
+	WeakWolfeBisection, // slow
+	HagerZhang, // approximate Wolfe conditions, see HagerZhang.hpp
+	ParallelBacktracking, // Backtracking with concurrent trial steps, value(x) must be thread safe
+	Nonmonotone // BacktrackingCubic against a reference above f(x), see NonmonotoneSettings
+};
+
+// Trust region subproblem method (see TrustRegion.hpp)
+enum class TRMethod {
+	CauchyPoint,
+	DogLeg,
+	SteihaugCG // matrix-free, uses Problem::hessian_vec
+};
+
+// Conjugate direction update of NonLinearCG (beta in p = -z + beta p)
+enum class CGMethod {
+	FletcherReeves,
+	PolakRibierePlus, // Polak-Ribiere clamped to beta >= 0
+	HestenesStiefel,
+	DaiYuan,
+	HagerZhang // CG_DESCENT update, guarantees descent
+};
+
+// Wall clock budget of a minimize call (MinimizerSettings::max_time). Started by
+// the solver (LineSearchState::deadline), and checked between iterations and
+// line search trials.
+struct Deadline {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point end;
+	bool active;
+
+	Deadline() : active(false) {}
+
+	void start(double seconds){
+		active = seconds > 0;
+		if( active ){ end = Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>(seconds) ); }
+	}
+
+	bool expired() const { return active && Clock::now() >= end; }
+};
+
+// Constants of the HagerZhang line search (MinimizerSettings::hz),
+// defaults are those of CG_DESCENT
+template<typename Scalar>
+struct HagerZhangSettings {
+	Scalar epsilon; // relative error in f allowed by the approximate Wolfe conditions
+	Scalar theta; // bisection point when the bracket is updated
+	Scalar gamma; // bisect if a secant step shrinks the bracket less than this
+	Scalar rho; // growth of the step while bracketing
+
+	HagerZhangSettings() : epsilon(1e-6), theta(0.5), gamma(0.66), rho(5) {}
+};
+
+// Nonmonotone line search (MinimizerSettings::nm). The Armijo condition is checked
+// against a reference value instead of f(x), so that f may increase for a few
+// iterations, e.g. when following a narrow curved valley. The reference is the
+// weighted average of past objectives of Zhang & Hager (2004), or the max over a
+// window of past objectives of Grippo, Lampariello & Lucidi (1986).
+template<typename Scalar>
+struct NonmonotoneSettings {
+	int window; // Grippo: max over the last window objectives, 0 = use the Zhang-Hager average
+	Scalar eta; // Zhang-Hager: weight of the past in the average, 0 = monotone
+
+	NonmonotoneSettings() : window(0), eta(0.85) {}
+};
+
+// Options of a Minimizer (Minimizer::Settings), also passed to the line searches
+template<typename Scalar>
+struct MinimizerSettings {
+	int verbose; // higher = more printouts
+	int max_iters; // usually changed by derived constructors
+	int ls_max_iters; // max line search iters
+	int ls_threads; // trial steps evaluated at once by ParallelBacktracking, 0 = hardware concurrency (serial in ParallelSolve)
+	Scalar ls_decrease; // sufficient decrease param
+	Scalar ls_curvature; // curvature condition param, used by HagerZhang
+	HagerZhangSettings<Scalar> hz; // see HagerZhangSettings (above)
+	NonmonotoneSettings<Scalar> nm; // see NonmonotoneSettings (above)
+	LSMethod ls_method; // see LSMethod (above), only used by the LineSearch policy
+	TRMethod tr_method; // see TRMethod (above)
+	CGMethod cg_method; // see CGMethod (above)
+	double max_time; // wall clock seconds per minimize, 0 = no limit
+
+	MinimizerSettings() : verbose(0), max_iters(100),
+		ls_max_iters(100000), ls_threads(0), ls_decrease(1e-4), ls_curvature(0.9),
+		ls_method(LSMethod::BacktrackingCubic),
+		tr_method(TRMethod::DogLeg),
+		cg_method(CGMethod::PolakRibierePlus),
+		max_time(0)
+		{}
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
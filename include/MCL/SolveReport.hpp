@@ -0,0 +1,274 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_SOLVEREPORT_H
+#define MCL_SOLVEREPORT_H
+
+#include "Problem.hpp"
+#include <chrono>
+#include <cstdio>
+#include <atomic>
+
+// Set to 1 to count and time the problem evaluations, which wraps the problem
+// in a ReportProblem and reads the clock around every evaluation. Termination
+// reasons and iteration counts are always reported.
+#ifndef MCL_SOLVE_REPORT
+#define MCL_SOLVE_REPORT 0
+#endif
+
+namespace mcl {
+namespace optlib {
+
+// Why minimize returned
+enum class Termination {
+	None = 0, // minimize has not been called
+	Converged, // Problem::converged returned true
+	MaxIters, // reached Settings::max_iters
+	NoProgress, // the gradient/step stopped changing
+	LineSearchFailure, // line search could not find a step
+	NaN, // encountered NaN/inf values
+	Callback, // Minimizer::m_callback returned false
+	Deadline // reached Settings::max_time
+};
+
+static inline const char* termination_string(Termination t){
+	switch( t ){
+		case Termination::None: return "none";
+		case Termination::Converged: return "converged";
+		case Termination::MaxIters: return "max iters";
+		case Termination::NoProgress: return "no progress";
+		case Termination::LineSearchFailure: return "line search failure";
+		case Termination::NaN: return "NaN";
+		case Termination::Callback: return "callback";
+		case Termination::Deadline: return "deadline";
+	}
+	return "unknown";
+}
+
+//
+// Statistics of the last call to Minimizer::minimize.
+// Times are wall clock seconds.
+//
+struct SolveReport {
+	int iters; // solver iterations
+	int ls_iters; // total line search iterations
+	int tr_rejected; // rejected trust region steps
+	int cg_iters; // total inner conjugate gradient iterations
+	Termination termination;
+
+	// Problem evaluations, only counted if MCL_SOLVE_REPORT.
+	// Problem::hessian_newton (and sparse_hessian_newton) counts as a hessian and a solve_hessian call.
+	int value_calls, gradient_calls, hessian_calls, solve_hessian_calls, hessian_vec_calls;
+	double value_time, gradient_time, hessian_time, solve_hessian_time, hessian_vec_time;
+	double total_time;
+
+	SolveReport(){ reset(); }
+
+	void reset(){
+		iters = 0; ls_iters = 0; tr_rejected = 0; cg_iters = 0;
+		termination = Termination::None;
+		value_calls = 0; gradient_calls = 0; hessian_calls = 0; solve_hessian_calls = 0; hessian_vec_calls = 0;
+		value_time = 0; gradient_time = 0; hessian_time = 0; solve_hessian_time = 0; hessian_vec_time = 0;
+		total_time = 0;
+	}
+
+	// Time spent in the problem
+	double problem_time() const {
+		return value_time + gradient_time + hessian_time + solve_hessian_time + hessian_vec_time;
+	}
+
+	// Time spent in the solver itself (line search, linear algebra, etc...)
+	double solver_time() const { return total_time - problem_time(); }
+
+	void print() const {
+		printf("Termination: %s\n", termination_string(termination));
+		printf("Iterations: %d (line search: %d, rejected steps: %d, cg: %d)\n", iters, ls_iters, tr_rejected, cg_iters);
+#if MCL_SOLVE_REPORT
+		printf("Total time: %fs (solver: %fs)\n", total_time, solver_time());
+		printf("value: %d calls, %fs\n", value_calls, value_time);
+		printf("gradient: %d calls, %fs\n", gradient_calls, gradient_time);
+		printf("hessian: %d calls, %fs\n", hessian_calls, hessian_time);
+		printf("solve_hessian: %d calls, %fs\n", solve_hessian_calls, solve_hessian_time);
+		printf("hessian_vec: %d calls, %fs\n", hessian_vec_calls, hessian_vec_time);
+#endif
+	}
+};
+
+//
+// Forwards everything to a problem while counting and timing
+// the evaluations. Used by the solvers' minimize if MCL_SOLVE_REPORT.
+// P is the type of the wrapped problem, either Problem (virtual calls)
+// or a StaticProblem (see StaticProblem.hpp), which are inlined. Like a
+// StaticProblem it only has the interface of Problem and none of its
+// buffers, so wrapping a problem does not allocate.
+// value may be called concurrently (see ParallelBacktracking) if the wrapped
+// problem allows it. Its counts are atomic and added to the report when the
+// wrapper is destroyed. The other functions are called by one thread at a time.
+//
+template<typename Scalar, int DIM, typename P = Problem<Scalar,DIM> >
+class ReportProblem {
+private:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+	typedef Eigen::SparseMatrix<Scalar> SparseMat;
+	typedef std::chrono::steady_clock Clock;
+
+	P &m_problem;
+	SolveReport &m_report;
+	std::atomic<int> m_value_calls;
+	std::atomic<long long> m_value_ns;
+
+	static inline double elapsed(const Clock::time_point &t0){
+		return std::chrono::duration<double>( Clock::now() - t0 ).count();
+	}
+
+public:
+	ReportProblem(P &problem, SolveReport &report) :
+		m_problem(problem), m_report(report), m_value_calls(0), m_value_ns(0) {}
+
+	~ReportProblem(){
+		m_report.value_calls += m_value_calls;
+		m_report.value_time += double(m_value_ns) * 1e-9;
+	}
+
+	// The problem being counted
+	P &wrapped(){ return m_problem; }
+
+	bool converged(const VecX &x0, const VecX &x1, const VecX &grad){
+		return m_problem.converged(x0,x1,grad);
+	}
+
+	Scalar value(const VecX &x){
+		Clock::time_point t0 = Clock::now();
+		Scalar fx = m_problem.value(x);
+		m_value_ns += std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - t0 ).count();
+		m_value_calls++;
+		return fx;
+	}
+
+	Scalar gradient(const VecX &x, VecX &grad){
+		Clock::time_point t0 = Clock::now();
+		Scalar fx = m_problem.gradient(x,grad);
+		m_report.gradient_time += elapsed(t0);
+		m_report.gradient_calls++;
+		return fx;
+	}
+
+	void hessian(const VecX &x, MatX &hess){
+		Clock::time_point t0 = Clock::now();
+		m_problem.hessian(x,hess);
+		m_report.hessian_time += elapsed(t0);
+		m_report.hessian_calls++;
+	}
+
+	bool hessian_pattern(SparseMat &pattern){ return m_problem.hessian_pattern(pattern); }
+
+	bool bounds(VecX &lower, VecX &upper){ return m_problem.bounds(lower,upper); }
+
+	bool precondition(const VecX &x, const VecX &grad, VecX &z){ return m_problem.precondition(x,grad,z); }
+
+	bool is_sparse(){ return m_problem.is_sparse(); }
+
+	void sparse_hessian(const VecX &x, SparseMat &hess){
+		Clock::time_point t0 = Clock::now();
+		m_problem.sparse_hessian(x,hess);
+		m_report.hessian_time += elapsed(t0);
+		m_report.hessian_calls++;
+	}
+
+	void solve_hessian(const VecX &x, const VecX &grad, VecX &dx){
+		Clock::time_point t0 = Clock::now();
+		m_problem.solve_hessian(x,grad,dx);
+		m_report.solve_hessian_time += elapsed(t0);
+		m_report.solve_hessian_calls++;
+	}
+
+	void hessian_newton(const VecX &x, const VecX &grad, MatX &hess, VecX &dx){
+		Clock::time_point t0 = Clock::now();
+		m_problem.hessian_newton(x,grad,hess,dx);
+		m_report.hessian_time += elapsed(t0);
+		m_report.hessian_calls++;
+		m_report.solve_hessian_calls++;
+	}
+
+	void sparse_hessian_newton(const VecX &x, const VecX &grad, SparseMat &hess, VecX &dx){
+		Clock::time_point t0 = Clock::now();
+		m_problem.sparse_hessian_newton(x,grad,hess,dx);
+		m_report.hessian_time += elapsed(t0);
+		m_report.hessian_calls++;
+		m_report.solve_hessian_calls++;
+	}
+
+	void hessian_vec(const VecX &x, const VecX &v, VecX &Hv){
+		Clock::time_point t0 = Clock::now();
+		m_problem.hessian_vec(x,v,Hv);
+		m_report.hessian_vec_time += elapsed(t0);
+		m_report.hessian_vec_calls++;
+	}
+};
+
+//
+// Resets the report and starts the timer of a solve, and stops it when it goes
+// out of scope. problem() is the problem the solver should use: a ReportProblem
+// if Report (MCL_SOLVE_REPORT), otherwise the problem itself. Report is a template
+// argument so that translation units built with different MCL_SOLVE_REPORT
+// use different types rather than different definitions of the same one.
+//
+template<typename Scalar, int DIM, typename P, bool Report = (MCL_SOLVE_REPORT != 0)>
+class ReportScope {
+public:
+	typedef ReportProblem<Scalar,DIM,P> Type;
+
+	ReportScope(P &problem, SolveReport &report) :
+		m_problem(problem, report), m_t0(std::chrono::steady_clock::now()), m_report(report) {
+		m_report.reset();
+	}
+
+	~ReportScope(){
+		m_report.total_time = std::chrono::duration<double>( std::chrono::steady_clock::now() - m_t0 ).count();
+	}
+
+	Type &problem(){ return m_problem; }
+
+private:
+	Type m_problem;
+	std::chrono::steady_clock::time_point m_t0;
+	SolveReport &m_report;
+};
+
+template<typename Scalar, int DIM, typename P>
+class ReportScope<Scalar,DIM,P,false> {
+public:
+	typedef P Type;
+
+	ReportScope(P &problem, SolveReport &report) : m_problem(problem) { report.reset(); }
+
+	Type &problem(){ return m_problem; }
+
+private:
+	Type &m_problem;
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
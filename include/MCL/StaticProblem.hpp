@@ -0,0 +1,128 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_STATICPROBLEM_H
+#define MCL_STATICPROBLEM_H
+
+#include "Problem.hpp"
+
+namespace mcl {
+namespace optlib {
+
+//
+// Problem interface resolved at compile time (CRTP), for small problems where
+// virtual calls keep the compiler from inlining the energy into the solver:
+//
+//	class MyProblem : public StaticProblem<MyProblem,double,2> {
+//		bool converged(const VecX &x0, const VecX &x1, const VecX &grad);
+//		double value(const VecX &x);
+//		double gradient(const VecX &x, VecX &grad); // optional
+//	};
+//	LBFGS<double,2> solver;
+//	solver.minimize(my_problem, x); // calls the templated minimize
+//
+// Functions defined in Derived hide the defaults below, which match the
+// defaults of Problem. Sparse hessians are not supported.
+//
+template<typename Derived, typename Scalar, int DIM>
+class StaticProblem {
+public:
+	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
+	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+	typedef Eigen::SparseMatrix<Scalar> SparseMat;
+
+	FiniteDiff<Scalar,DIM> m_fd; // used by the finite difference defaults
+
+	StaticProblem() : m_fd_gradient(false), m_newton_hess(nullptr) {}
+
+	// Compute the objective value and the gradient
+	inline Scalar gradient(const VecX &x, VecX &grad){
+		m_fd_gradient = true;
+		m_fd.gradient( [this](const VecX &xx){ return this->derived().value(xx); }, x, grad );
+		return derived().value(x);
+	}
+
+	// Compute hessian, see Problem::finiteHessian
+	inline void hessian(const VecX &x, MatX &hess){
+		if( m_fd_gradient ){
+			m_fd.hessian_value( [this](const VecX &xx){ return this->derived().value(xx); }, x, hess );
+			return;
+		}
+		m_fd.hessian( [this](const VecX &xx, VecX &g){ this->derived().gradient(xx,g); }, x, hess );
+	}
+
+	// Solve dx = H^-1 -g (used by Newton's)
+	inline void solve_hessian(const VecX &x, const VecX &grad, VecX &dx){
+		if( m_newton_hess ){ // called by hessian_newton
+			Problem<Scalar,DIM>::solve_dense(*m_newton_hess, grad, dx);
+			return;
+		}
+		MatX hess = MatX::Zero(x.rows(),x.rows());
+		derived().hessian(x,hess);
+		Problem<Scalar,DIM>::solve_dense(hess, grad, dx);
+	}
+
+	// Compute the hessian and the Newton step (used by TrustRegion),
+	// see Problem::hessian_newton
+	inline void hessian_newton(const VecX &x, const VecX &grad, MatX &hess, VecX &dx){
+		derived().hessian(x,hess);
+		m_newton_hess = &hess;
+		derived().solve_hessian(x,grad,dx);
+		m_newton_hess = nullptr;
+	}
+
+	// Compute Hv = H(x)*v (used by NewtonCG and TRMethod::SteihaugCG)
+	inline void hessian_vec(const VecX &x, const VecX &v, VecX &Hv){
+		m_fd.hessian_vec( [this](const VecX &xx, VecX &g){ this->derived().gradient(xx,g); }, x, v, Hv );
+	}
+
+	// Box constraints, see Problem::bounds
+	inline bool bounds(VecX &lower, VecX &upper){ (void)(lower); (void)(upper); return false; }
+
+	// Preconditioner, see Problem::precondition
+	inline bool precondition(const VecX &x, const VecX &grad, VecX &z){ (void)(x); (void)(grad); (void)(z); return false; }
+
+	inline bool is_sparse(){ return false; }
+
+	inline bool hessian_pattern(SparseMat &pattern){ (void)(pattern); return false; }
+
+	inline void sparse_hessian(const VecX &x, SparseMat &hess){
+		(void)(x); (void)(hess);
+		throw std::runtime_error("StaticProblem::sparse_hessian Error: sparse hessians not supported");
+	}
+
+	inline void sparse_hessian_newton(const VecX &x, const VecX &grad, SparseMat &hess, VecX &dx){
+		(void)(x); (void)(grad); (void)(hess); (void)(dx);
+		throw std::runtime_error("StaticProblem::sparse_hessian_newton Error: sparse hessians not supported");
+	}
+
+protected:
+	bool m_fd_gradient; // set by the default gradient
+	const MatX *m_newton_hess; // see Problem::hessian_newton
+
+	inline Derived &derived(){ return *static_cast<Derived*>(this); }
+};
+
+} // ns optlib
+} // ns mcl
+
+#endif
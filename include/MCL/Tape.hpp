@@ -0,0 +1,246 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_TAPE_H
+#define MCL_TAPE_H
+
+#include <vector>
+#include <cmath>
+
+namespace mcl {
+namespace optlib {
+
+template<typename Scalar> class ADVar;
+
+//
+// Reverse-mode automatic differentiation tape (Wengert list).
+// Every operation on ADVars appends a node with its value and the partial
+// derivatives w.r.t. its (up to two) arguments. The gradient is then
+// one backward sweep over the nodes, a small constant times the cost
+// of the recorded evaluation regardless of the number of inputs.
+//
+// Nodes live in a buffer that is cleared, not freed, before each
+// recording, so after the first evaluation (warm-up) recording does not
+// allocate. A recorded tape can also be replayed at a new x, which skips
+// the user's code entirely. Replay is only valid if the energy has the same
+// control flow at the new x: branches on ADVar::value() and constants computed
+// from it are frozen at their recorded values.
+//
+// See ReverseDiffProblem.hpp for use with the solvers.
+//
+template<typename Scalar>
+class ADTape {
+public:
+	enum class Op { Input, Const, Add, Sub, Mul, Div, Neg, Sin, Cos, Exp, Log, Sqrt, Pow, Abs };
+
+	struct Node {
+		Op op;
+		int a, b; // arguments (node indices), -1 if unused
+		Scalar val; // value
+		Scalar da, db; // partial derivatives w.r.t. a and b
+	};
+
+	ADTape() : m_n_inputs(0), m_output(-1) {}
+
+	// Clears the tape and adds the inputs as the first nodes.
+	// x is any vector type with rows() and operator[].
+	template<typename VecT>
+	void record(const VecT &x, std::vector< ADVar<Scalar> > &vars){
+		m_nodes.clear();
+		m_output = -1;
+		m_n_inputs = x.rows();
+		vars.resize(m_n_inputs);
+		for( int i=0; i<m_n_inputs; ++i ){
+			vars[i] = ADVar<Scalar>( this, push(Op::Input, -1, -1, x[i]) );
+		}
+	}
+
+	// Marks the result of the recorded energy
+	void set_output(const ADVar<Scalar> &f){
+		m_output = f.m_tape == this ? f.m_index : push(Op::Const, -1, -1, f.value());
+	}
+
+	// True if a complete tape with n inputs has been recorded
+	bool recorded(int n) const { return m_output >= 0 && m_n_inputs == n; }
+
+	// Re-evaluates every node at new inputs x
+	template<typename VecT>
+	void replay(const VecT &x){
+		for( int i=0; i<m_n_inputs; ++i ){ m_nodes[i].val = x[i]; }
+		const int n_nodes = m_nodes.size();
+		for( int i=m_n_inputs; i<n_nodes; ++i ){
+			Node &n = m_nodes[i];
+			eval(n, arg(n.a), arg(n.b));
+		}
+	}
+
+	// Value of the output
+	Scalar value() const { return m_nodes[m_output].val; }
+
+	// Backward sweep, sets grad to the derivative of the output
+	// w.r.t. each input. grad must have as many rows as the inputs.
+	template<typename VecT>
+	void gradient(VecT &grad){
+		m_adj.assign(m_output+1, Scalar(0));
+		m_adj[m_output] = 1;
+		for( int i=m_output; i>=m_n_inputs; --i ){
+			const Node &n = m_nodes[i];
+			const Scalar adj = m_adj[i];
+			if( adj == Scalar(0) ){ continue; }
+			if( n.a >= 0 ){ m_adj[n.a] += n.da * adj; }
+			if( n.b >= 0 ){ m_adj[n.b] += n.db * adj; }
+		}
+		for( int i=0; i<m_n_inputs; ++i ){ grad[i] = m_adj[i]; }
+	}
+
+	// Number of nodes and allocated nodes
+	int size() const { return m_nodes.size(); }
+	int capacity() const { return m_nodes.capacity(); }
+
+	// Appends a node and computes its value and partials
+	int push(Op op, int a, int b, Scalar val=0){
+		Node n;
+		n.op = op; n.a = a; n.b = b;
+		n.val = val; n.da = 0; n.db = 0;
+		if( op != Op::Input && op != Op::Const ){ eval(n, arg(a), arg(b)); }
+		m_nodes.push_back(n);
+		return int(m_nodes.size())-1;
+	}
+
+	Scalar node_value(int i) const { return m_nodes[i].val; }
+
+	// Value and partials of the operation n.op with argument values a and b
+	static inline void eval(Node &n, Scalar a, Scalar b){
+		using std::sin; using std::cos; using std::exp; using std::log;
+		using std::sqrt; using std::pow; using std::abs;
+		switch( n.op ){
+			case Op::Input:
+			case Op::Const: break;
+			case Op::Add: n.val = a + b; n.da = 1; n.db = 1; break;
+			case Op::Sub: n.val = a - b; n.da = 1; n.db = -1; break;
+			case Op::Mul: n.val = a * b; n.da = b; n.db = a; break;
+			case Op::Div: n.val = a / b; n.da = Scalar(1) / b; n.db = -n.val / b; break;
+			case Op::Neg: n.val = -a; n.da = -1; break;
+			case Op::Sin: n.val = sin(a); n.da = cos(a); break;
+			case Op::Cos: n.val = cos(a); n.da = -sin(a); break;
+			case Op::Exp: n.val = exp(a); n.da = n.val; break;
+			case Op::Log: n.val = log(a); n.da = Scalar(1) / a; break;
+			case Op::Sqrt: n.val = sqrt(a); n.da = Scalar(0.5) / n.val; break;
+			case Op::Pow: {
+				n.val = pow(a, b);
+				n.da = b * pow(a, b - Scalar(1));
+				n.db = a > Scalar(0) ? n.val * log(a) : Scalar(0);
+			} break;
+			case Op::Abs: n.val = abs(a); n.da = a < Scalar(0) ? Scalar(-1) : Scalar(1); break;
+		}
+	}
+
+private:
+	std::vector<Node> m_nodes;
+	std::vector<Scalar> m_adj;
+	int m_n_inputs;
+	int m_output;
+
+	inline Scalar arg(int i) const { return i >= 0 ? m_nodes[i].val : Scalar(0); }
+
+}; // end class ADTape
+
+
+//
+// Scalar recorded on an ADTape. An ADVar without a tape is a constant,
+// so expressions like ADVar e = 0; e += x[0]*x[1]; work as expected.
+//
+template<typename Scalar>
+class ADVar {
+public:
+	typedef ADTape<Scalar> Tape;
+	typedef typename Tape::Op Op;
+
+	ADVar() : m_tape(nullptr), m_index(-1), m_const(0) {}
+	ADVar(Scalar c) : m_tape(nullptr), m_index(-1), m_const(c) {}
+	ADVar(Tape *tape, int index) : m_tape(tape), m_index(index), m_const(0) {}
+
+	Scalar value() const { return m_tape ? m_tape->node_value(m_index) : m_const; }
+
+	ADVar &operator+=(const ADVar &b){ *this = *this + b; return *this; }
+	ADVar &operator-=(const ADVar &b){ *this = *this - b; return *this; }
+	ADVar &operator*=(const ADVar &b){ *this = *this * b; return *this; }
+	ADVar &operator/=(const ADVar &b){ *this = *this / b; return *this; }
+
+	friend ADVar operator+(const ADVar &a, const ADVar &b){ return binary(Op::Add, a, b); }
+	friend ADVar operator-(const ADVar &a, const ADVar &b){ return binary(Op::Sub, a, b); }
+	friend ADVar operator*(const ADVar &a, const ADVar &b){ return binary(Op::Mul, a, b); }
+	friend ADVar operator/(const ADVar &a, const ADVar &b){ return binary(Op::Div, a, b); }
+	friend ADVar operator-(const ADVar &a){ return unary(Op::Neg, a); }
+	friend ADVar sin(const ADVar &a){ return unary(Op::Sin, a); }
+	friend ADVar cos(const ADVar &a){ return unary(Op::Cos, a); }
+	friend ADVar exp(const ADVar &a){ return unary(Op::Exp, a); }
+	friend ADVar log(const ADVar &a){ return unary(Op::Log, a); }
+	friend ADVar sqrt(const ADVar &a){ return unary(Op::Sqrt, a); }
+	friend ADVar abs(const ADVar &a){ return unary(Op::Abs, a); }
+	friend ADVar pow(const ADVar &a, const ADVar &b){ return binary(Op::Pow, a, b); }
+
+	// Comparisons use the recorded values (see ADTape about replay)
+	friend bool operator<(const ADVar &a, const ADVar &b){ return a.value() < b.value(); }
+	friend bool operator>(const ADVar &a, const ADVar &b){ return a.value() > b.value(); }
+	friend bool operator<=(const ADVar &a, const ADVar &b){ return a.value() <= b.value(); }
+	friend bool operator>=(const ADVar &a, const ADVar &b){ return a.value() >= b.value(); }
+
+private:
+	friend class ADTape<Scalar>;
+	Tape *m_tape; // nullptr if constant
+	int m_index; // node on the tape
+	Scalar m_const; // value if constant
+
+	// Node index of v on tape, adding constants as nodes
+	static inline int node(Tape *tape, const ADVar &v){
+		return v.m_tape ? v.m_index : tape->push(Op::Const, -1, -1, v.m_const);
+	}
+
+	// Operation on constants, not recorded
+	static inline ADVar fold(Op op, Scalar a, Scalar b){
+		typename Tape::Node n;
+		n.op = op; n.a = -1; n.b = -1;
+		n.val = 0; n.da = 0; n.db = 0;
+		Tape::eval(n, a, b);
+		return ADVar(n.val);
+	}
+
+	static inline ADVar unary(Op op, const ADVar &a){
+		if( !a.m_tape ){ return fold(op, a.m_const, 0); }
+		return ADVar( a.m_tape, a.m_tape->push(op, a.m_index, -1) );
+	}
+
+	static inline ADVar binary(Op op, const ADVar &a, const ADVar &b){
+		Tape *tape = a.m_tape ? a.m_tape : b.m_tape;
+		if( !tape ){ return fold(op, a.m_const, b.m_const); }
+		int ia = node(tape, a);
+		int ib = node(tape, b);
+		return ADVar( tape, tape->push(op, ia, ib) );
+	}
+
+}; // end class ADVar
+
+} // ns optlib
+} // ns mcl
+
+#endif
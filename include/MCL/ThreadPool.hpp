@@ -0,0 +1,167 @@
+// The MIT License (MIT)
+// Copyright (c) 2018 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_THREADPOOL_H
+#define MCL_THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+namespace mcl {
+namespace optlib {
+
+//
+// Persistent worker threads for parallel loops. The calling thread
+// takes part in every loop, so a pool of size 1 has no workers and
+// runs everything serially.
+//
+class ThreadPool {
+public:
+	// n_threads = 0 uses the hardware concurrency
+	explicit ThreadPool(int n_threads=0) : m_job(nullptr), m_job_data(nullptr), m_job_id(0), m_running(0), m_stop(false) {
+		if( n_threads <= 0 ){ n_threads = std::max(1, int(std::thread::hardware_concurrency())); }
+		for( int i=1; i<n_threads; ++i ){
+			m_workers.emplace_back( &ThreadPool::work, this, i );
+		}
+	}
+
+	~ThreadPool(){
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_start.notify_all();
+		for( size_t i=0; i<m_workers.size(); ++i ){ m_workers[i].join(); }
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of threads, including the caller
+	int size() const { return int(m_workers.size())+1; }
+
+	// True if the calling thread is running the body of a parallel_for
+	// (of any pool), e.g. to run nested parallel loops serially.
+	static bool in_parallel(){ return depth() > 0; }
+
+	// Calls func(i, thread) for every i in [0,n) and blocks until done.
+	// thread is in [0,size()) and can be used to index per-thread buffers.
+	// Indices are handed out dynamically in chunks of grain.
+	template<typename F>
+	void parallel_for(int n, const F &func, int grain=1){
+		if( n <= 0 ){ return; }
+		grain = std::max(grain,1);
+		if( m_workers.empty() || n <= grain ){
+			Scope scope;
+			for( int i=0; i<n; ++i ){ func(i,0); }
+			return;
+		}
+
+		Loop<F> loop(n, grain, func);
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_job = &Loop<F>::run;
+			m_job_data = &loop;
+			m_running = int(m_workers.size());
+			m_job_id++;
+		}
+		m_start.notify_all();
+		Loop<F>::run(&loop, 0);
+
+		// Wait for workers to finish before the loop goes out of scope
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait( lock, [this]{ return m_running == 0; } );
+		m_job = nullptr;
+		m_job_data = nullptr;
+	}
+
+private:
+	// A parallel_for in progress, shared by all threads
+	template<typename F>
+	struct Loop {
+		std::atomic<int> next;
+		const int n, grain;
+		const F &func;
+		Loop(int n_, int grain_, const F &func_) : next(0), n(n_), grain(grain_), func(func_) {}
+		static void run(void *data, int thread){
+			Scope scope;
+			Loop *loop = static_cast<Loop*>(data);
+			const int n = loop->n, grain = loop->grain;
+			for( int begin = loop->next.fetch_add(grain); begin < n; begin = loop->next.fetch_add(grain) ){
+				int end = std::min(begin+grain, n);
+				for( int i=begin; i<end; ++i ){ loop->func(i,thread); }
+			}
+		}
+	};
+
+	// Number of parallel_for bodies the calling thread is in
+	static inline int &depth(){
+		static thread_local int d = 0;
+		return d;
+	}
+
+	struct Scope {
+		Scope(){ depth()++; }
+		~Scope(){ depth()--; }
+	};
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_start, m_done;
+	void (*m_job)(void*, int); // current Loop<F>::run
+	void *m_job_data; // current Loop<F>
+	int m_job_id; // incremented for every new job
+	int m_running; // workers still on the current job
+	bool m_stop;
+
+	void work(int thread){
+		int last_job = 0;
+		while( true ){
+			void (*job)(void*, int) = nullptr;
+			void *job_data = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_start.wait( lock, [&]{ return m_stop || m_job_id != last_job; } );
+				if( m_stop ){ return; }
+				last_job = m_job_id;
+				job = m_job;
+				job_data = m_job_data;
+			}
+			job(job_data, thread);
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_running--;
+			}
+			m_done.notify_one();
+		}
+	}
+
+}; // end class ThreadPool
+
+} // ns optlib
+} // ns mcl
+
+#endif
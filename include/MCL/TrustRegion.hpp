@@ -28,26 +28,72 @@ namespace mcl {
 namespace optlib {
 
 template<typename Scalar, int DIM>
-class TrustRegion : public Minimizer<Scalar,DIM> {
+class TrustRegion : public MinimizerImpl<TrustRegion<Scalar,DIM>,Scalar,DIM> {
 private:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
+	typedef Eigen::SparseMatrix<Scalar> SparseMat;
 
 public:
 	//
 	// The trust region method operates on an approximate hessian (B).
-	// To keep the interface simple, Problem::hessian is used to obtain
-	// this approximation. It shouldn't be much of a problem, since you
-	// can still use approximations for Newton's (the only other method
-	// implemented that requires a hessian evaluation).
-	//
-	// TODO Replace B with possibly sparse representation
+	// To keep the interface simple, Problem::hessian_newton is used to obtain
+	// this approximation and the Newton step together. It shouldn't be much
+	// of a problem, since you can still use approximations for Newton's (the
+	// only other method implemented that requires a hessian evaluation).
+	// If the problem has a sparse hessian (Problem::hessian_pattern),
+	// B is stored as a sparse matrix instead.
+	// With TRMethod::SteihaugCG, B is never formed: the subproblem is
+	// solved with CG using Problem::hessian_vec, and solve_hessian is not used.
 	//
 	TrustRegion() {
 		this->m_settings.max_iters = 100;
 	}
 
-	int minimize(Problem<Scalar,DIM> &problem, VecX &x){
+protected:
+	friend class MinimizerImpl<TrustRegion,Scalar,DIM>;
+
+	template<typename P>
+	int solve_impl(P &problem, VecX &x){
+		// Reuse buffers from the last call if possible
+		const bool sparse = problem.is_sparse();
+		if( this->m_settings.tr_method == TRMethod::SteihaugCG ){
+			m_ws.resize(x.rows(), false, false);
+			return minimize_cg(problem, x);
+		}
+		m_ws.resize(x.rows(), sparse, true);
+		if( sparse ){ return minimize_B(problem, x, m_ws.B_sparse); }
+		return minimize_B(problem, x, m_ws.B);
+	}
+
+	// Buffers that persist between calls to minimize
+	struct Workspace {
+		VecX grad, dx, dx_newton, x_last, x_trial;
+		VecX Bv, dx_U, dx_C; // used by eval_reduction and eval_subproblem
+		VecX r, d; // used by steihaug_cg
+		MatX B;
+		SparseMat B_sparse;
+		void resize(int dim, bool sparse, bool need_B){
+			if( grad.rows() != dim ){
+				grad = VecX::Zero(dim);
+				dx = VecX::Zero(dim);
+				dx_newton = VecX::Zero(dim);
+				x_last = VecX::Zero(dim);
+				x_trial = VecX::Zero(dim);
+				Bv = VecX::Zero(dim);
+				dx_U = VecX::Zero(dim);
+				dx_C = VecX::Zero(dim);
+				r = VecX::Zero(dim);
+				d = VecX::Zero(dim);
+			}
+			if( !need_B ){ return; }
+			if( sparse && B_sparse.rows() != dim ){ B_sparse.resize(dim,dim); }
+			if( !sparse && B.rows() != dim ){ B = MatX::Zero(dim,dim); }
+		}
+	} m_ws;
+
+	template<typename P, typename MatB>
+	int minimize_B(P &problem, VecX &x, MatB &B){
 
 		Scalar delta_k = 2.0; // trust region radius
 		const Scalar delta_max = 8.0; // max trust region radius
@@ -55,82 +101,225 @@ public:
 		const TRMethod m = this->m_settings.tr_method;
 		int max_iters = this->m_settings.max_iters;
 		int verbose = this->m_settings.verbose;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
 
-		VecX grad, dx, x_last;
-		MatX B; // Approximate hessian
-		if( DIM  == Eigen::Dynamic ){
-			int dim = x.rows();
-			x_last.resize(dim); // last variable
-			grad.resize(dim); // grad at k
-			dx.resize(dim); // descent direction
-			B.resize(dim,dim);
-		}
+		VecX &grad = m_ws.grad; // grad at k
+		VecX &dx = m_ws.dx; // descent direction
+		VecX &dx_newton = m_ws.dx_newton; // newton step at x, kept if a step is rejected
+		VecX &x_last = m_ws.x_last; // last variable
+		VecX &x_trial = m_ws.x_trial; // x + dx
 
 		// Init gradient and hessian
 		Scalar fxk = problem.gradient(x,grad); // gradient and objective
-		problem.hessian(x,B); // get hessian (or approximation)
-		problem.solve_hessian(x,grad,dx); // attempt with newtons
+		this->begin_solve(x, fxk);
+		eval_hessian_newton(problem,x,grad,B,dx_newton); // hessian and attempt with newtons
 
 		int iter = 0;
 		for( ; iter < max_iters; ++iter ){
 
 			// If it's outside the trust region, pick new descent
+			dx = dx_newton;
 			if( dx.norm() > delta_k ){
-				eval_subproblem(m, delta_k, grad, B, dx);
+				eval_subproblem(m, delta_k, grad, B, dx, m_ws);
 			}
 
-			Scalar fxdx = problem.value(x+dx);
+			x_trial = x + dx;
+			Scalar fxdx = problem.value(x_trial);
 
 			// Compute reduction ratio
-			Scalar rho_k = eval_reduction(fxk, fxdx, dx, grad, B);
+			Scalar rho_k = eval_reduction(fxk, fxdx, dx, grad, B, m_ws.Bv);
 			Scalar dx_norm = dx.norm();
 
 			// Update trust region radius
-			if( rho_k < 0.25 ){ delta_k = 0.25*delta_k; }
+			if( rho_k < Scalar(0.25) ){ delta_k = Scalar(0.25)*delta_k; }
 
 			// Full step, good approximation
-			else if( rho_k > 0.75 && std::abs(dx_norm-delta_k) <= 0.0 ){
-				delta_k = std::min( 2.0*delta_k, delta_max );
+			else if( rho_k > Scalar(0.75) && std::abs(dx_norm-delta_k) <= Scalar(0) ){
+				delta_k = std::min( Scalar(2)*delta_k, delta_max );
 			}
 
 			// Take a step, otherwise need to re-eval sub problem
 			if( rho_k > eta ){
 
 				x_last = x;
-				x = x + dx;
+				x += dx;
 
 				// Only need to compute gradient and hessian
 				// if x has actually changed.
 				fxk = problem.gradient(x,grad); // gradient and objective
-				if( problem.converged(x_last,x,grad) ){ break; }
+				if( problem.converged(x_last,x,grad) ){ report.termination = Termination::Converged; }
+				if( this->end_iteration(iter, x_last, x, fxk, grad) ){ break; }
+
+				eval_hessian_newton(problem,x,grad,B,dx_newton); // hessian and attempt with newtons
+			}
 
-				// I think I should improve this as to not call both hessian
-				// and solve_hessian, which likely causes redundant computation.
-				problem.hessian(x,B); // get hessian (or approximation)
-				problem.solve_hessian(x,grad,dx); // attempt with newtons
+			// Only the radius changes, B and the newton step are reused
+			else {
+				report.tr_rejected++;
+				if( this->stop_on_deadline(x, fxk) ){ break; }
 			}
 
 			if( std::isnan(rho_k) ){
 				if( verbose ){ printf("\n**TrustRegion Error: NaN reduction"); }
+				report.iters = iter;
+				report.termination = Termination::NaN;
 				return Minimizer<Scalar,DIM>::FAILURE;
 			}
 
 		}
 
+		report.iters = iter;
 		return iter;
 
 	} // end minimize
 
-protected:
+	// Trust region with the Steihaug-Toint CG subproblem,
+	// only needs hessian-vector products.
+	template<typename P>
+	int minimize_cg(P &problem, VecX &x){
+
+		Scalar delta_k = 2.0; // trust region radius
+		const Scalar delta_max = 8.0; // max trust region radius
+		const Scalar eta = 0.125; // min reduction ratio allowed (0<eta<0.25)
+		int max_iters = this->m_settings.max_iters;
+		int verbose = this->m_settings.verbose;
+		SolveReport &report = this->m_report;
+		report.termination = Termination::MaxIters;
+
+		VecX &grad = m_ws.grad; // grad at k
+		VecX &dx = m_ws.dx; // descent direction
+		VecX &x_last = m_ws.x_last; // last variable
+		VecX &x_trial = m_ws.x_trial; // x + dx
+		VecX &Bdx = m_ws.Bv; // B*dx, tracked by steihaug_cg
+
+		Scalar fxk = problem.gradient(x,grad); // gradient and objective
+		this->begin_solve(x, fxk);
+
+		int iter = 0;
+		for( ; iter < max_iters; ++iter ){
+
+			// Already at a stationary point, the model has no descent
+			if( grad.squaredNorm() <= 0 ){
+				report.termination = Termination::Converged;
+				break;
+			}
+
+			bool on_boundary = false;
+			report.cg_iters += steihaug_cg(problem, x, grad, delta_k, dx, Bdx, on_boundary);
+
+			x_trial = x + dx;
+			Scalar fxdx = problem.value(x_trial);
+
+			// Compute reduction ratio
+			Scalar rho_k = eval_ratio(fxk, fxdx, -( dx.dot(grad) + Scalar(0.5)*dx.dot(Bdx) ));
+
+			// Update trust region radius
+			if( rho_k < Scalar(0.25) ){ delta_k = Scalar(0.25)*delta_k; }
+			else if( rho_k > Scalar(0.75) && on_boundary ){
+				delta_k = std::min( Scalar(2)*delta_k, delta_max );
+			}
+
+			if( rho_k > eta ){
+				x_last = x;
+				x += dx;
+				fxk = problem.gradient(x,grad);
+				if( problem.converged(x_last,x,grad) ){ report.termination = Termination::Converged; }
+				if( this->end_iteration(iter, x_last, x, fxk, grad) ){ break; }
+			}
+			else {
+				report.tr_rejected++;
+				if( this->stop_on_deadline(x, fxk) ){ break; }
+			}
+
+			if( std::isnan(rho_k) ){
+				if( verbose ){ printf("\n**TrustRegion Error: NaN reduction"); }
+				report.iters = iter;
+				report.termination = Termination::NaN;
+				return Minimizer<Scalar,DIM>::FAILURE;
+			}
+		}
+
+		report.iters = iter;
+		return iter;
+	}
+
+	// Steihaug-Toint CG (Nocedal & Wright, Algorithm 7.2).
+	// Approximately minimizes grad^T dx + 0.5 dx^T B dx with |dx| <= delta,
+	// stopping at the boundary or on negative curvature. Bdx = B*dx on output,
+	// on_boundary is set to true if |dx| = delta. Returns the CG iterations.
+	template<typename P>
+	int steihaug_cg(P &problem, const VecX &x, const VecX &grad,
+		Scalar delta, VecX &dx, VecX &Bdx, bool &on_boundary){
+
+		const int dim = x.rows();
+		VecX &r = m_ws.r; // residual B*dx + grad
+		VecX &d = m_ws.d; // search direction
+		VecX &Bd = m_ws.dx_U;
+		const Scalar grad_norm = grad.norm();
+		const Scalar tol = std::min( Scalar(0.5), std::sqrt(grad_norm) ) * grad_norm;
+
+		dx.setZero();
+		Bdx.setZero();
+		r = grad;
+		d = -r;
+		Scalar rr = r.squaredNorm();
+		on_boundary = false;
+
+		int j = 0;
+		for( ; j < dim; ++j ){
+			problem.hessian_vec(x, d, Bd);
+			Scalar dBd = d.dot(Bd);
+
+			// Negative curvature, go to the boundary along d
+			if( dBd <= 0 ){
+				Scalar tau = max_roots( d.squaredNorm(), Scalar(2)*dx.dot(d), dx.squaredNorm() - delta*delta );
+				dx.noalias() += tau*d;
+				Bdx.noalias() += tau*Bd;
+				on_boundary = true;
+				return j+1;
+			}
+
+			// Step leaves the trust region, stop at the boundary
+			Scalar alpha = rr / dBd;
+			if( (dx + alpha*d).norm() >= delta ){
+				Scalar tau = max_roots( d.squaredNorm(), Scalar(2)*dx.dot(d), dx.squaredNorm() - delta*delta );
+				dx.noalias() += tau*d;
+				Bdx.noalias() += tau*Bd;
+				on_boundary = true;
+				return j+1;
+			}
+
+			dx.noalias() += alpha*d;
+			Bdx.noalias() += alpha*Bd;
+			r.noalias() += alpha*Bd;
+			Scalar rr_new = r.squaredNorm();
+			if( std::sqrt(rr_new) < tol ){ return j+1; }
+			d = -r + (rr_new/rr)*d;
+			rr = rr_new;
+		}
+
+		return j;
+	}
+
+	template<typename P>
+	static inline void eval_hessian_newton(P &problem, const VecX &x, const VecX &grad, MatX &B, VecX &dx){
+		problem.hessian_newton(x,grad,B,dx);
+	}
+
+	template<typename P>
+	static inline void eval_hessian_newton(P &problem, const VecX &x, const VecX &grad, SparseMat &B, VecX &dx){
+		problem.sparse_hessian_newton(x,grad,B,dx);
+	}
 
 	// Assumes coeffs size 3
 	static inline Scalar max_roots(Scalar a, Scalar b, Scalar c){
 
-		Scalar d = (b*b) - (4.0*a*c);
+		Scalar d = (b*b) - (Scalar(4)*a*c);
 		if( d > 0 ){
 			Scalar sqrt_d = std::sqrt(d);
-			Scalar r1 = (-b + sqrt_d) / (2.0*a);
-			Scalar r2 = (-b - sqrt_d) / (2.0*a);
+			Scalar r1 = (-b + sqrt_d) / (Scalar(2)*a);
+			Scalar r2 = (-b - sqrt_d) / (Scalar(2)*a);
 			return std::max(r1,r2);
 		}
 		// Should I do something with the real/imaginary parts?
@@ -145,21 +334,33 @@ protected:
 	// dx = descent direction
 	// grad_k = gradient at x_k 
 	// B_k = hessian guess.
+	// Bdx = buffer for B_k*dx
+	template<typename MatB>
 	static inline Scalar eval_reduction( Scalar fxk, Scalar fxdx, const VecX &dx,
-		const VecX &grad_k, const MatX &B_k ){
+		const VecX &grad_k, const MatB &B_k, VecX &Bdx ){
 		// rho = ( f(x) - f(x-dx) ) / ( model(0) - model(dx) )
 		// with model = f(x) + dx^T grad + 0.5 dx^T B dx
-		Scalar num = fxk - fxdx;
-		Scalar denom = fxk - ( fxk + dx.dot(grad_k) + 0.5 * dx.dot( B_k * dx ) );
-		return num/denom;
+		Bdx.noalias() = B_k * dx;
+		Scalar denom = fxk - ( fxk + dx.dot(grad_k) + Scalar(0.5) * dx.dot( Bdx ) );
+		return eval_ratio(fxk, fxdx, denom);
 	}
 
+	// Ratio of actual to predicted reduction. Both are shifted by the
+	// rounding error of f (Conn, Gould & Toint, Section 17.4.2) so that
+	// steps near the solution are not rejected because of round off.
+	static inline Scalar eval_ratio( Scalar fxk, Scalar fxdx, Scalar predicted ){
+		const Scalar shift = Scalar(10) * std::numeric_limits<Scalar>::epsilon() * std::max( Scalar(1), std::abs(fxk) );
+		return ( fxk - fxdx + shift ) / ( predicted + shift );
+	}
+
+	template<typename MatB>
 	static inline void eval_subproblem(
 		const TRMethod &m, Scalar delta_k,
-		const VecX &grad, const MatX &B,
-		VecX &dx ){
+		const VecX &grad, const MatB &B,
+		VecX &dx, Workspace &ws ){
 
-		Scalar gTBg = grad.dot(B*grad);
+		ws.Bv.noalias() = B*grad;
+		Scalar gTBg = grad.dot(ws.Bv);
 
 		switch( m ){
 
@@ -168,7 +369,7 @@ protected:
 
 				Scalar grad_norm = grad.norm();
 				Scalar tau = 1.0;
-				if( gTBg > 0.0 ){ tau = std::min( 1.0, std::pow(grad_norm,3) / (delta_k*gTBg) ); }
+				if( gTBg > 0 ){ tau = std::min( Scalar(1), grad_norm*grad_norm*grad_norm / (delta_k*gTBg) ); }
 				dx = ( -tau * delta_k / grad_norm ) * grad;
 
 			} break;
@@ -177,18 +378,20 @@ protected:
 			case TRMethod::DogLeg: {
 
 				Scalar gTg = grad.dot(grad);
-				VecX dx_U = ( -gTg / gTBg ) * grad;
+				VecX &dx_U = ws.dx_U;
+				dx_U = ( -gTg / gTBg ) * grad;
 				Scalar dx_U_norm = dx_U.norm();
 
 				// Use steepest descent
 				if( dx_U_norm >= delta_k ){ dx = delta_k/dx_U_norm * dx_U; }
 				else{
 					// Compute tau and update descent
-					VecX dx_C = dx - dx_U;
+					VecX &dx_C = ws.dx_C;
+					dx_C = dx - dx_U;
 					Scalar dx_C_norm = dx_C.norm();
 					Scalar tau = max_roots( // Ax^2 + Bx + c
 						dx_C_norm*dx_C_norm,
-						2.0*dx_C.dot(dx_U),
+						Scalar(2)*dx_C.dot(dx_U),
 						dx_U_norm*dx_U_norm - delta_k*delta_k
 					);
 					dx = dx_U + tau*dx_C;
@@ -196,6 +399,9 @@ protected:
 
 			} break;
 
+			// Solved by steihaug_cg instead, see minimize_cg
+			case TRMethod::SteihaugCG: break;
+
 		} // end swithc method
 
 	} // end eval sub problem
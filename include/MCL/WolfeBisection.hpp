@@ -23,6 +23,7 @@
 #define MCL_WOLFEBISECTION_H
 
 #include "Problem.hpp"
+#include "LineSearchState.hpp"
 
 namespace mcl {
 namespace optlib {
@@ -49,23 +50,24 @@ public:
 	typedef Eigen::Matrix<Scalar,DIM,1> VecX;
 	typedef Eigen::Matrix<Scalar,DIM,DIM> MatX;
 
-	static inline Scalar search(int verbose, int max_iters, const VecX &x, const VecX &p, Problem<Scalar,DIM> &problem, Scalar alpha0) {
-
+	// fx and grad are f(x) and its gradient on input, and f(x+alpha*p)
+	// and its gradient at the returned alpha on output.
+	// x_trial and grad_trial are preallocated buffers (same size as x)
+	// iters = number of trial steps on output
+	template<typename P>
+	static inline Scalar search(const MinimizerSettings<Scalar> &settings, LineSearchState<Scalar,DIM> &state, const VecX &x, const VecX &p, P &problem, Scalar alpha0,
+		Scalar &fx, VecX &grad, VecX &x_trial, VecX &grad_trial, int &iters) {
+		const int verbose = settings.verbose;
+		const int max_iters = settings.ls_max_iters;
 		const Scalar t_eps = std::numeric_limits<Scalar>::epsilon();
 		const Scalar wolfe_c1 = 0.0001;
 		const Scalar wolfe_c2 = 0.8; // should be 0.1 for CG!
-		const int dim = x.rows();
-		double alpha = alpha0;
-		double alpha_min = 1e-8;
-		double alpha_max = 1;
-
-		VecX grad0, grad_new;
-		if( DIM == Eigen::Dynamic ){
-			grad0 = VecX::Zero(dim);
-			grad_new = VecX::Zero(dim);
-		}
-		Scalar fx0 = problem.gradient(x, grad0);
-		const Scalar gtp = grad0.dot(p);
+		Scalar alpha = alpha0;
+		Scalar alpha_min = std::max( Scalar(1e-8), t_eps );
+		Scalar alpha_max = 1;
+
+		const Scalar fx0 = fx;
+		const Scalar gtp = grad.dot(p);
 		bool min_set = false;
 
 		int iter = 0;
@@ -73,29 +75,34 @@ public:
 
 			// Should we stop iterating?
 			if( std::abs(alpha_max-alpha_min) <= t_eps ){ break; }
+			if( state.deadline.expired() ){ break; } // keep alpha_min if set
 
 			// Step halfway
-			alpha = ( alpha_max + alpha_min ) * 0.5;
-			grad_new.setZero();
-			Scalar fx_ap = problem.gradient(x + alpha*p, grad_new);
-			Scalar gt_ap = grad_new.dot( p );
+			alpha = ( alpha_max + alpha_min ) * Scalar(0.5);
+			grad_trial.setZero();
+			x_trial = x + alpha*p;
+			Scalar fx_ap = problem.gradient(x_trial, grad_trial);
+			Scalar gt_ap = grad_trial.dot( p );
 
 			// Check the wolfe conditions
 			bool happy_wolfe = strong_wolfe( alpha, fx0, gtp, fx_ap, gt_ap, wolfe_c1, wolfe_c2 );
 			if( happy_wolfe ){
 				alpha_min = alpha;
 				min_set = true;
+				fx = fx_ap;
+				grad.swap(grad_trial); // keep gradient at alpha_min
 			}
 			else { alpha_max = alpha; }
 
 		} // end bs iters
+		iters = iter;
 
 		if( iter == max_iters ){
 			if( verbose > 0 ){ printf("WolfeBisection::linesearch Error: Reached max_iters\n"); }
 			return -1;
 		}
 		if( !min_set ){
-			if( verbose > 0 ){ printf("WolfeBisection::linesearch Error: LS blocked\n"); }
+			if( verbose > 0 && !state.deadline.expired() ){ printf("WolfeBisection::linesearch Error: LS blocked\n"); }
 			return -1;
 		}
 
@@ -0,0 +1,659 @@
+// The MIT License (MIT)
+// Copyright (c) 2017 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef MCL_BENCHPROBLEM_H
+#define MCL_BENCHPROBLEM_H
+
+#include "MCL/Problem.hpp"
+#include "MCL/BatchProblem.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <chrono>
+
+// Scalable problems for benchSolvers
+
+// min 0.5 sum d_i x_i^2 - x_i, with d_i in [1,100].
+// Cheap gradient, so solver overhead dominates the run time.
+class SeparableQuadratic : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+
+	VectorX d;
+	SeparableQuadratic( int dim_ ){
+		d = VectorX::LinSpaced(dim_, 1.0, 100.0);
+	}
+
+	// Runs to max_iters
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0); (void)(grad);
+		return false;
+	}
+
+	double value(const VectorX &x){
+		return 0.5*x.dot(d.cwiseProduct(x)) - x.sum();
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		grad = d.cwiseProduct(x).array() - 1.0;
+		return value(x);
+	}
+};
+
+// min 0.5 x^T L x + 0.25 sum x_i^4 - b^T x, with L the 1D Laplacian.
+// Sparse (tridiagonal) hessian L + 3 diag(x^2) that changes with x.
+// If use_pattern is false, Newton's and TrustRegion use dense hessians.
+class QuarticChain : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	typedef Eigen::SparseMatrix<double> SparseMatrixX;
+
+	SparseMatrixX L;
+	VectorX b;
+	bool use_pattern;
+	QuarticChain( int dim_, bool use_pattern_=true ) : use_pattern(use_pattern_) {
+		std::vector< Eigen::Triplet<double> > triplets;
+		for( int i=0; i<dim_; ++i ){
+			triplets.emplace_back( i, i, 2.0 );
+			if( i > 0 ){ triplets.emplace_back( i, i-1, -1.0 ); }
+			if( i+1 < dim_ ){ triplets.emplace_back( i, i+1, -1.0 ); }
+		}
+		L.resize(dim_,dim_);
+		L.setFromTriplets( triplets.begin(), triplets.end() );
+		b = VectorX::Ones(dim_);
+	}
+
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < 1e-8;
+	}
+
+	double value(const VectorX &x){
+		return 0.5*x.dot(L*x) + 0.25*x.array().pow(4).sum() - b.dot(x);
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		grad = L*x + x.array().cube().matrix() - b;
+		return value(x);
+	}
+
+	void hessian(const VectorX &x, MatrixX &hess){
+		hess = MatrixX(L);
+		hess.diagonal().array() += 3.0*x.array().square();
+	}
+
+	bool hessian_pattern(SparseMatrixX &pattern){
+		pattern = L;
+		return use_pattern;
+	}
+
+	void sparse_hessian(const VectorX &x, SparseMatrixX &hess){
+		hess = L;
+		for( int i=0; i<x.rows(); ++i ){ hess.coeffRef(i,i) += 3.0*x[i]*x[i]; }
+	}
+
+	void hessian_vec(const VectorX &x, const VectorX &v, VectorX &Hv){
+		Hv = L*v + 3.0*x.array().square().matrix().cwiseProduct(v);
+	}
+};
+
+// min sum_d 0.5 (x_d - c)^2 + 0.25 (x_d - c)^4, with c = c_i for problem i.
+// Tiny problem solved many times, with a scalar (SmallQuartic) and batch version.
+class SmallQuartic : public mcl::optlib::Problem<double,3> {
+public:
+	typedef Eigen::Matrix<double,3,1> VectorX;
+	double c;
+	SmallQuartic() : c(0) {}
+
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.squaredNorm() < 1e-16;
+	}
+
+	double value(const VectorX &x){
+		Eigen::Array3d u = x.array() - c;
+		return (0.5*u.square() + 0.25*u.square().square()).sum();
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		Eigen::Array3d u = x.array() - c;
+		grad = (u + u.cube()).matrix();
+		return (0.5*u.square() + 0.25*u.square().square()).sum();
+	}
+};
+
+template<int LANES>
+class BatchSmallQuartic : public mcl::optlib::BatchProblem<double,3,LANES> {
+public:
+	typedef mcl::optlib::BatchProblem<double,3,LANES> Base;
+	typedef typename Base::BatchX BatchX;
+	typedef typename Base::BatchS BatchS;
+	typedef typename Base::BatchI BatchI;
+	typedef typename Base::BatchB BatchB;
+
+	Eigen::ArrayXd c;
+	BatchSmallQuartic( const Eigen::ArrayXd &c_ ) : c(c_) {}
+
+	void converged(const BatchI &index, const BatchX &x0, const BatchX &x1, const BatchX &grad, BatchB &done){
+		(void)(index); (void)(x0); (void)(x1);
+		done = grad.square().rowwise().sum() < 1e-16;
+	}
+
+	void value(const BatchI &index, const BatchX &x, BatchS &fx){
+		BatchX u;
+		shift(index, x, u);
+		fx = (0.5*u.square() + 0.25*u.square().square()).rowwise().sum();
+	}
+
+	void gradient(const BatchI &index, const BatchX &x, BatchX &grad, BatchS &fx){
+		BatchX u;
+		shift(index, x, u);
+		grad = u + u.cube();
+		fx = (0.5*u.square() + 0.25*u.square().square()).rowwise().sum();
+	}
+
+	void solve_hessian(const BatchI &index, const BatchX &x, const BatchX &grad, BatchX &dx){
+		BatchX u;
+		shift(index, x, u);
+		dx = -grad / (1.0 + 3.0*u.square());
+	}
+
+private:
+	inline void shift(const BatchI &index, const BatchX &x, BatchX &u){
+		BatchS ci;
+		for( int l=0; l<LANES; ++l ){ ci(l) = c(index(l)); }
+		for( int d=0; d<3; ++d ){ u.col(d) = x.col(d) - ci; }
+	}
+};
+
+//
+// Problems of the benchmark suite (benchSolvers suite), scalable from 10 to 10^6 variables.
+// The requested dimension is rounded to one the problem supports, see dim().
+// All have sparse hessians given by a fixed pattern, so that Newton's and
+// TrustRegion use sparse factorizations at any size. value is safe to call
+// concurrently, for LSMethod::ParallelBacktracking.
+//
+class SuiteProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::SparseMatrix<double> SparseMatrixX;
+
+	double tol; // max abs gradient at convergence
+	SuiteProblem() : tol(1e-6) {}
+
+	virtual std::string name() const = 0;
+
+	// Starting point of the solve
+	virtual void init(VectorX &x) = 0;
+
+	int dim() const { return m_pattern.rows(); }
+
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.lpNorm<Eigen::Infinity>() < tol;
+	}
+
+	bool hessian_pattern(SparseMatrixX &pattern){
+		pattern = m_pattern;
+		return true;
+	}
+
+protected:
+	SparseMatrixX m_pattern;
+
+	// Pattern of bs x bs blocks (both triangles), given as pairs of block indices
+	void set_pattern( int dim_, int bs, const std::vector< std::pair<int,int> > &blocks ){
+		std::vector< Eigen::Triplet<double> > triplets;
+		for( size_t b=0; b<blocks.size(); ++b ){
+			for( int i=0; i<bs; ++i ){
+				for( int j=0; j<bs; ++j ){
+					triplets.emplace_back( blocks[b].first*bs+i, blocks[b].second*bs+j, 1.0 );
+					triplets.emplace_back( blocks[b].second*bs+j, blocks[b].first*bs+i, 1.0 );
+				}
+			}
+		}
+		m_pattern.resize(dim_,dim_);
+		m_pattern.setFromTriplets( triplets.begin(), triplets.end() );
+		m_pattern.makeCompressed();
+	}
+
+	// Sets hess to the pattern with zero values, reusing its memory if possible
+	void zero_hessian( SparseMatrixX &hess ){
+		if( hess.rows() != m_pattern.rows() || hess.nonZeros() != m_pattern.nonZeros() || !hess.isCompressed() ){
+			hess = m_pattern;
+		}
+		hess.coeffs().setZero();
+	}
+
+	template<typename Block>
+	static inline void add_block( SparseMatrixX &hess, int r, int c, const Block &B ){
+		for( int i=0; i<B.rows(); ++i ){
+			for( int j=0; j<B.cols(); ++j ){ hess.coeffRef(r+i,c+j) += B(i,j); }
+		}
+	}
+};
+
+// Extended Rosenbrock, sum of 100 (x_2i+1 - x_2i^2)^2 + (1 - x_2i)^2.
+// Starts at (-1.2, 1, -1.2, 1, ...), minimum at ones.
+class ExtendedRosenbrock : public SuiteProblem {
+public:
+	ExtendedRosenbrock( int dim_ ){
+		int n = std::max(1,dim_/2);
+		std::vector< std::pair<int,int> > blocks;
+		for( int i=0; i<n; ++i ){ blocks.emplace_back(i,i); }
+		set_pattern( 2*n, 2, blocks );
+	}
+
+	std::string name() const { return "rosenbrock"; }
+
+	void init(VectorX &x){
+		x.resize(dim());
+		for( int i=0; i<dim(); i+=2 ){ x[i] = -1.2; x[i+1] = 1.0; }
+	}
+
+	double value(const VectorX &x){
+		double fx = 0;
+		for( int i=0; i<x.rows(); i+=2 ){
+			double a = 1.0 - x[i];
+			double b = x[i+1] - x[i]*x[i];
+			fx += a*a + 100.0*b*b;
+		}
+		return fx;
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		double fx = 0;
+		for( int i=0; i<x.rows(); i+=2 ){
+			double a = 1.0 - x[i];
+			double b = x[i+1] - x[i]*x[i];
+			fx += a*a + 100.0*b*b;
+			grad[i] = -2.0*a - 400.0*x[i]*b;
+			grad[i+1] = 200.0*b;
+		}
+		return fx;
+	}
+
+	void sparse_hessian(const VectorX &x, SparseMatrixX &hess){
+		zero_hessian(hess);
+		for( int i=0; i<x.rows(); i+=2 ){
+			Eigen::Matrix2d H;
+			H << 1200.0*x[i]*x[i] - 400.0*x[i+1] + 2.0, -400.0*x[i],
+				-400.0*x[i], 200.0;
+			add_block( hess, i, i, H );
+		}
+	}
+};
+
+// ExtendedRosenbrock that sleeps for delay microseconds per evaluation, like an
+// expensive energy. Safe to evaluate concurrently (see ParallelBacktracking).
+class SlowExtendedRosenbrock : public ExtendedRosenbrock {
+public:
+	int delay;
+	SlowExtendedRosenbrock( int dim_, int delay_ ) : ExtendedRosenbrock(dim_), delay(delay_) {}
+
+	double value(const VectorX &x){
+		std::this_thread::sleep_for( std::chrono::microseconds(delay) );
+		return ExtendedRosenbrock::value(x);
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		std::this_thread::sleep_for( std::chrono::microseconds(delay) );
+		return ExtendedRosenbrock::gradient(x, grad);
+	}
+};
+
+// Extended Powell singular function, sum over blocks of four of
+// (a + 10b)^2 + 5(c - d)^2 + (b - 2c)^4 + 10(a - d)^4.
+// Starts at (3, -1, 0, 1, ...), minimum at zero where the hessian is singular.
+class ExtendedPowell : public SuiteProblem {
+public:
+	ExtendedPowell( int dim_ ){
+		int n = std::max(1,dim_/4);
+		std::vector< std::pair<int,int> > blocks;
+		for( int i=0; i<n; ++i ){ blocks.emplace_back(i,i); }
+		set_pattern( 4*n, 4, blocks );
+	}
+
+	std::string name() const { return "powell"; }
+
+	void init(VectorX &x){
+		x.resize(dim());
+		for( int i=0; i<dim(); i+=4 ){ x.segment<4>(i) = Eigen::Vector4d(3,-1,0,1); }
+	}
+
+	double value(const VectorX &x){
+		double fx = 0;
+		for( int i=0; i<x.rows(); i+=4 ){
+			double t1 = x[i] + 10.0*x[i+1];
+			double t2 = x[i+2] - x[i+3];
+			double t3 = x[i+1] - 2.0*x[i+2];
+			double t4 = x[i] - x[i+3];
+			fx += t1*t1 + 5.0*t2*t2 + t3*t3*t3*t3 + 10.0*t4*t4*t4*t4;
+		}
+		return fx;
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		for( int i=0; i<x.rows(); i+=4 ){
+			double t1 = x[i] + 10.0*x[i+1];
+			double t2 = x[i+2] - x[i+3];
+			double t3 = x[i+1] - 2.0*x[i+2];
+			double t4 = x[i] - x[i+3];
+			grad[i] = 2.0*t1 + 40.0*t4*t4*t4;
+			grad[i+1] = 20.0*t1 + 4.0*t3*t3*t3;
+			grad[i+2] = 10.0*t2 - 8.0*t3*t3*t3;
+			grad[i+3] = -10.0*t2 - 40.0*t4*t4*t4;
+		}
+		return value(x);
+	}
+
+	void sparse_hessian(const VectorX &x, SparseMatrixX &hess){
+		zero_hessian(hess);
+		for( int i=0; i<x.rows(); i+=4 ){
+			double t3 = x[i+1] - 2.0*x[i+2];
+			double t4 = x[i] - x[i+3];
+			double s3 = 12.0*t3*t3;
+			double s4 = 120.0*t4*t4;
+			Eigen::Matrix4d H;
+			H << 2.0 + s4, 20.0, 0.0, -s4,
+				20.0, 200.0 + s3, -2.0*s3, 0.0,
+				0.0, -2.0*s3, 10.0 + 4.0*s3, -10.0,
+				-s4, 0.0, -10.0, 10.0 + s4;
+			add_block( hess, i, i, H );
+		}
+	}
+};
+
+// min 0.5 x^T A x - b^T x with A = tridiag(-1, 2.01, -1) and b = ones.
+// Constant hessian with a condition number of about 400 at large sizes.
+class TridiagonalQuadratic : public SuiteProblem {
+public:
+	SparseMatrixX A;
+	VectorX b;
+	TridiagonalQuadratic( int dim_ ){
+		int n = std::max(1,dim_);
+		std::vector< std::pair<int,int> > blocks;
+		for( int i=0; i<n; ++i ){
+			blocks.emplace_back(i,i);
+			if( i+1 < n ){ blocks.emplace_back(i,i+1); }
+		}
+		set_pattern( n, 1, blocks );
+		zero_hessian(A);
+		for( int i=0; i<n; ++i ){
+			A.coeffRef(i,i) = 2.01;
+			if( i+1 < n ){ A.coeffRef(i,i+1) = -1.0; A.coeffRef(i+1,i) = -1.0; }
+		}
+		b = VectorX::Ones(n);
+	}
+
+	std::string name() const { return "quadratic"; }
+
+	void init(VectorX &x){ x = VectorX::Zero(dim()); }
+
+	double value(const VectorX &x){
+		return 0.5*x.dot(A*x) - b.dot(x);
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		grad = A*x - b;
+		return 0.5*x.dot(grad - b);
+	}
+
+	void sparse_hessian(const VectorX &x, SparseMatrixX &hess){
+		(void)(x);
+		hess = A;
+	}
+
+	void hessian_vec(const VectorX &x, const VectorX &v, VectorX &Hv){
+		(void)(x);
+		Hv = A*v;
+	}
+};
+
+// TridiagonalQuadratic with 0 <= x <= 10, which is active in the middle of the chain.
+// The box is given to the solver (Problem::bounds) if penalty is zero,
+// otherwise it is enforced with the quadratic penalty 0.5 penalty |x - P(x)|^2.
+class BoxTridiagonal : public TridiagonalQuadratic {
+public:
+	double penalty;
+	BoxTridiagonal( int dim_, double penalty_ ) : TridiagonalQuadratic(dim_), penalty(penalty_) {}
+
+	std::string name() const { return penalty > 0 ? "box (penalty)" : "box (bounds)"; }
+
+	bool bounds(VectorX &lower, VectorX &upper){
+		if( penalty > 0 ){ return false; }
+		lower = VectorX::Zero(dim());
+		upper = VectorX::Constant(dim(), 10.0);
+		return true;
+	}
+
+	double value(const VectorX &x){
+		double fx = TridiagonalQuadratic::value(x);
+		if( penalty > 0 ){ fx += 0.5*penalty*violation(x).squaredNorm(); }
+		return fx;
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		double fx = TridiagonalQuadratic::gradient(x, grad);
+		if( penalty > 0 ){
+			VectorX v = violation(x);
+			fx += 0.5*penalty*v.squaredNorm();
+			grad += penalty*v;
+		}
+		return fx;
+	}
+
+	// x - P(x), the distance outside of the box
+	VectorX violation(const VectorX &x) const {
+		return x - x.cwiseMax(0.0).cwiseMin(10.0);
+	}
+};
+
+// A chain of n free nodes in 2D connected by springs, with its ends
+// pinned at (0,0) and (1,0), sagging under gravity. The rest length
+// is shorter than the spacing, so the springs stay in tension and
+// the hessian positive definite. Starts from the straight chain.
+class MassSpringChain : public SuiteProblem {
+public:
+	int n; // free nodes
+	double spacing, rest, k, mg;
+	MassSpringChain( int dim_ ) : n( std::max(1,dim_/2) ) {
+		spacing = 1.0 / (n+1);
+		rest = 0.8*spacing;
+		k = 1.0 / spacing;
+		mg = spacing;
+		std::vector< std::pair<int,int> > blocks;
+		for( int i=0; i<n; ++i ){
+			blocks.emplace_back(i,i);
+			if( i+1 < n ){ blocks.emplace_back(i,i+1); }
+		}
+		set_pattern( 2*n, 2, blocks );
+	}
+
+	std::string name() const { return "springs"; }
+
+	void init(VectorX &x){
+		x = VectorX::Zero(dim());
+		for( int i=0; i<n; ++i ){ x[2*i] = (i+1)*spacing; }
+	}
+
+	double value(const VectorX &x){
+		double fx = 0;
+		for( int s=0; s<=n; ++s ){
+			double l = (node(x,s+1) - node(x,s)).norm();
+			fx += 0.5*k*(l-rest)*(l-rest);
+		}
+		for( int i=0; i<n; ++i ){ fx += mg*x[2*i+1]; }
+		return fx;
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		double fx = 0;
+		for( int i=0; i<n; ++i ){ grad.segment<2>(2*i) = Eigen::Vector2d(0,mg); fx += mg*x[2*i+1]; }
+		for( int s=0; s<=n; ++s ){
+			Eigen::Vector2d d = node(x,s+1) - node(x,s);
+			double l = d.norm();
+			fx += 0.5*k*(l-rest)*(l-rest);
+			Eigen::Vector2d f = k*(l-rest)/l * d;
+			if( s > 0 ){ grad.segment<2>(2*(s-1)) -= f; }
+			if( s < n ){ grad.segment<2>(2*s) += f; }
+		}
+		return fx;
+	}
+
+	void sparse_hessian(const VectorX &x, SparseMatrixX &hess){
+		zero_hessian(hess);
+		for( int s=0; s<=n; ++s ){
+			Eigen::Vector2d d = node(x,s+1) - node(x,s);
+			double l = d.norm();
+			Eigen::Vector2d u = d / l;
+			Eigen::Matrix2d H = k*( (1.0 - rest/l)*Eigen::Matrix2d::Identity() + (rest/l)*u*u.transpose() );
+			if( s > 0 ){ add_block( hess, 2*(s-1), 2*(s-1), H ); }
+			if( s < n ){ add_block( hess, 2*s, 2*s, H ); }
+			if( s > 0 && s < n ){
+				add_block( hess, 2*(s-1), 2*s, -H );
+				add_block( hess, 2*s, 2*(s-1), -H );
+			}
+		}
+	}
+
+private:
+	// Position of node i in 0..n+1, where 0 and n+1 are pinned
+	inline Eigen::Vector2d node(const VectorX &x, int i) const {
+		if( i == 0 ){ return Eigen::Vector2d(0,0); }
+		if( i == n+1 ){ return Eigen::Vector2d(1,0); }
+		return x.segment<2>(2*(i-1));
+	}
+};
+
+// A unit square of m x m cells (two triangles each) of compressible
+// neo-Hookean material hanging under gravity from its pinned top row.
+// Energy per triangle is area * ( mu/2 (tr(F^T F) - 2) - mu log J + lambda/2 (log J)^2 ),
+// and infinite if the triangle inverts. The hessian uses the default
+// finite differences of the gradient with a coloring of the pattern.
+class NeoHookeanPatch : public SuiteProblem {
+public:
+	int m; // cells per side
+	double mu, lambda, g;
+	NeoHookeanPatch( int dim_ ) : mu(1.0), lambda(10.0), g(0.5) {
+		// 2 m (m+1) free coordinates
+		m = std::max( 1, int( (std::sqrt(1.0 + 2.0*dim_) - 1.0) / 2.0 ) );
+		double h = 1.0 / m;
+		std::vector< std::pair<int,int> > blocks;
+		for( int j=0; j<m; ++j ){
+			for( int i=0; i<m; ++i ){
+				int v00 = vertex(i,j), v10 = vertex(i+1,j), v01 = vertex(i,j+1), v11 = vertex(i+1,j+1);
+				add_triangle( Eigen::Vector3i(v00,v10,v11), h, blocks );
+				add_triangle( Eigen::Vector3i(v00,v11,v01), h, blocks );
+			}
+		}
+		set_pattern( 2*m*(m+1), 2, blocks );
+		vertex_mg = g*h*h;
+	}
+
+	std::string name() const { return "neohookean"; }
+
+	void init(VectorX &x){
+		x.resize(dim());
+		for( int v=0; v<m*(m+1); ++v ){ x.segment<2>(2*v) = rest(v); }
+	}
+
+	double value(const VectorX &x){
+		double fx = 0;
+		for( size_t t=0; t<tris.size(); ++t ){
+			Eigen::Matrix2d F = deformation(x,t);
+			double J = F.determinant();
+			if( !(J > 0) ){ return std::numeric_limits<double>::infinity(); }
+			double logJ = std::log(J);
+			fx += area[t]*( 0.5*mu*(F.squaredNorm() - 2.0) - mu*logJ + 0.5*lambda*logJ*logJ );
+		}
+		for( int v=0; v<m*(m+1); ++v ){ fx += vertex_mg*x[2*v+1]; }
+		return fx;
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		double fx = 0;
+		for( int v=0; v<m*(m+1); ++v ){ grad.segment<2>(2*v) = Eigen::Vector2d(0,vertex_mg); fx += vertex_mg*x[2*v+1]; }
+		for( size_t t=0; t<tris.size(); ++t ){
+			Eigen::Matrix2d F = deformation(x,t);
+			double J = F.determinant();
+			if( !(J > 0) ){ return std::numeric_limits<double>::infinity(); }
+			double logJ = std::log(J);
+			fx += area[t]*( 0.5*mu*(F.squaredNorm() - 2.0) - mu*logJ + 0.5*lambda*logJ*logJ );
+			Eigen::Matrix2d FinvT = F.inverse().transpose();
+			Eigen::Matrix2d P = mu*(F - FinvT) + lambda*logJ*FinvT;
+			Eigen::Matrix2d H = area[t] * P * Dm_inv[t].transpose();
+			const Eigen::Vector3i &tri = tris[t];
+			if( tri[0] >= 0 ){ grad.segment<2>(2*tri[0]) -= H.col(0) + H.col(1); }
+			if( tri[1] >= 0 ){ grad.segment<2>(2*tri[1]) += H.col(0); }
+			if( tri[2] >= 0 ){ grad.segment<2>(2*tri[2]) += H.col(1); }
+		}
+		return fx;
+	}
+
+private:
+	// Triangles as free vertex indices, or -1-i for pinned top row vertex i
+	std::vector<Eigen::Vector3i> tris;
+	std::vector<Eigen::Matrix2d> Dm_inv;
+	std::vector<double> area;
+	double vertex_mg;
+
+	inline int vertex(int i, int j) const { return j < m ? j*(m+1)+i : -1-i; }
+
+	inline Eigen::Vector2d rest(int v) const {
+		if( v < 0 ){ return Eigen::Vector2d( double(-1-v)/m, 1.0 ); }
+		return Eigen::Vector2d( double(v%(m+1))/m, double(v/(m+1))/m );
+	}
+
+	inline Eigen::Vector2d position(const VectorX &x, int v) const {
+		return v < 0 ? rest(v) : Eigen::Vector2d( x.segment<2>(2*v) );
+	}
+
+	inline Eigen::Matrix2d deformation(const VectorX &x, size_t t) const {
+		const Eigen::Vector3i &tri = tris[t];
+		Eigen::Vector2d x0 = position(x,tri[0]);
+		Eigen::Matrix2d Ds;
+		Ds.col(0) = position(x,tri[1]) - x0;
+		Ds.col(1) = position(x,tri[2]) - x0;
+		return Ds * Dm_inv[t];
+	}
+
+	void add_triangle( const Eigen::Vector3i &tri, double h, std::vector< std::pair<int,int> > &blocks ){
+		Eigen::Vector2d X0 = rest(tri[0]);
+		Eigen::Matrix2d Dm;
+		Dm.col(0) = rest(tri[1]) - X0;
+		Dm.col(1) = rest(tri[2]) - X0;
+		tris.emplace_back(tri);
+		Dm_inv.emplace_back(Dm.inverse());
+		area.emplace_back(0.5*h*h);
+		for( int a=0; a<3; ++a ){
+			for( int b=0; b<3; ++b ){
+				if( tri[a] >= 0 && tri[b] >= 0 ){ blocks.emplace_back(tri[a],tri[b]); }
+			}
+		}
+	}
+};
+
+#endif
@@ -20,8 +20,14 @@
 // SOFTWARE.
 
 #include "MCL/Problem.hpp"
+#include "MCL/BatchProblem.hpp"
+#include "MCL/StaticProblem.hpp"
+#include "MCL/AutoDiffProblem.hpp"
+#include "MCL/ReverseDiffProblem.hpp"
+#include <thread>
+#include <chrono>
 
-// min |Ax-b|
+// min 0.5 x^T A x - b^T x, i.e. Ax = b
 class DynProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
 public:
 	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
@@ -65,7 +71,7 @@ public:
 			throw std::runtime_error("Error in Problem::value: x wrong dimension");
 		}
 
-		return (A*x-b).norm();
+		return 0.5*x.dot(A*x) - b.dot(x);
 	}
 
 	double gradient(const VectorX &x, VectorX &grad){
@@ -113,6 +119,232 @@ public:
 	}
 };
 
+// min 0.5 x^T A x - b^T x, with A random SPD.
+// Does not allocate memory after construction.
+class QuadProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+
+	MatrixX A;
+	VectorX b, Ax;
+	Eigen::LLT<MatrixX> llt;
+	double tol; // gradient norm at convergence
+	QuadProblem( int dim_ ) : tol(1e-10) {
+		A = MatrixX::Random(dim_,dim_);
+		A = A.transpose() * A;
+		A = A + MatrixX::Identity(dim_,dim_);
+		b = VectorX::Random(dim_);
+		Ax = VectorX::Zero(dim_);
+		llt.compute(A);
+	}
+
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < tol;
+	}
+
+	double value(const VectorX &x){
+		Ax.noalias() = A*x;
+		return 0.5*x.dot(Ax) - b.dot(x);
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		grad.noalias() = A*x;
+		grad -= b;
+		return 0.5*x.dot(grad) - 0.5*b.dot(x);
+	}
+
+	void hessian(const VectorX &x, MatrixX &hess){
+		(void)(x);
+		hess = A;
+	}
+
+	void solve_hessian(const VectorX &x, const VectorX &grad, VectorX &dx){
+		(void)(x);
+		dx = -grad;
+		llt.solveInPlace(dx);
+	}
+};
+
+// 0.5 |x|^2 with an exact hessian, so that a Newton step from any x
+// lands on a zero gradient, and a converged that is not gradient based
+class IdentityQuadProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x0); (void)(x1); (void)(grad);
+		return false;
+	}
+	double value(const VectorX &x){ return 0.5*x.squaredNorm(); }
+	double gradient(const VectorX &x, VectorX &grad){
+		grad = x;
+		return value(x);
+	}
+	void hessian(const VectorX &x, MatrixX &hess){ hess = MatrixX::Identity(x.rows(),x.rows()); }
+	void hessian_vec(const VectorX &x, const VectorX &v, VectorX &Hv){
+		(void)(x);
+		Hv = v;
+	}
+};
+
+// QuadProblem with the box lower <= x <= upper (see Problem::bounds)
+class BoxQuadProblem : public QuadProblem {
+public:
+	VectorX lower, upper;
+	BoxQuadProblem( int dim_, double bound ) : QuadProblem(dim_) {
+		b *= 10.0; // so that the unconstrained minimum is outside the box
+		lower = VectorX::Constant(dim_, -bound);
+		upper = VectorX::Constant(dim_, bound);
+	}
+	bool bounds(VectorX &lower_, VectorX &upper_){
+		lower_ = lower;
+		upper_ = upper;
+		return true;
+	}
+};
+
+// QuadProblem with a well conditioned A = I + R^T R / n, with rows and columns
+// scaled from 1 to 100 so that only the Jacobi preconditioner diag(A) undoes it
+// (used if use_precond, see Problem::precondition)
+class ScaledQuadProblem : public QuadProblem {
+public:
+	VectorX diag;
+	bool use_precond;
+	ScaledQuadProblem( int dim_ ) : QuadProblem(dim_), use_precond(false) {
+		MatrixX R = MatrixX::Random(dim_,dim_);
+		VectorX s = VectorX::LinSpaced(dim_, 0.0, 2.0).unaryExpr( [](double e){ return std::pow(10.0, e); } );
+		A = R.transpose() * R / double(dim_) + MatrixX::Identity(dim_,dim_);
+		A = s.asDiagonal() * A * s.asDiagonal();
+		llt.compute(A);
+		diag = A.diagonal();
+	}
+	bool precondition(const VectorX &x, const VectorX &grad, VectorX &z){
+		(void)(x);
+		if( !use_precond ){ return false; }
+		z = grad.cwiseQuotient(diag);
+		return true;
+	}
+};
+
+// min 0.5 x^T A x - b^T x, with A tridiagonal SPD
+class SparseProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	typedef Eigen::SparseMatrix<double> SparseMatrixX;
+
+	SparseMatrixX A;
+	VectorX b;
+	bool fd_hessian; // use the default finite difference hessians
+	SparseProblem( int dim_ ) : fd_hessian(false) {
+		std::vector< Eigen::Triplet<double> > triplets;
+		for( int i=0; i<dim_; ++i ){
+			triplets.emplace_back( i, i, 4.0 );
+			if( i > 0 ){ triplets.emplace_back( i, i-1, -1.0 ); }
+			if( i+1 < dim_ ){ triplets.emplace_back( i, i+1, -1.0 ); }
+		}
+		A.resize(dim_,dim_);
+		A.setFromTriplets( triplets.begin(), triplets.end() );
+		b = VectorX::Random(dim_);
+	}
+
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < 1e-10;
+	}
+
+	double value(const VectorX &x){
+		return 0.5*x.dot(A*x) - b.dot(x);
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		grad = A*x - b;
+		return value(x);
+	}
+
+	void hessian(const VectorX &x, MatrixX &hess){
+		if( fd_hessian ){ return finiteHessian(x,hess); }
+		hess = MatrixX(A);
+	}
+
+	void hessian_vec(const VectorX &x, const VectorX &v, VectorX &Hv){
+		if( fd_hessian ){ return Problem::hessian_vec(x,v,Hv); }
+		Hv = A*v;
+	}
+
+	bool hessian_pattern(SparseMatrixX &pattern){
+		pattern = A;
+		return true;
+	}
+
+	void sparse_hessian(const VectorX &x, SparseMatrixX &hess){
+		if( x.rows() != A.rows() ){
+			throw std::runtime_error("Error in Problem::sparse_hessian: x wrong dimension");
+		}
+		if( fd_hessian ){ return finiteSparseHessian(x,hess); }
+		hess = A;
+	}
+};
+
+// Wraps a problem and counts evaluations, including gradients that are
+// evaluated again at an iterate where the gradient is already known.
+class CountProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+
+	mcl::optlib::Problem<double,Eigen::Dynamic> *problem;
+	int n_value, n_gradient, n_repeat_gradient, n_solve_hessian;
+	VectorX last_iterate; // set by the first gradient and by converged
+	CountProblem( mcl::optlib::Problem<double,Eigen::Dynamic> *problem_ ) :
+		problem(problem_), n_value(0), n_gradient(0), n_repeat_gradient(0), n_solve_hessian(0) {}
+
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		last_iterate = x1;
+		return problem->converged(x0,x1,grad);
+	}
+
+	double value(const VectorX &x){
+		n_value++;
+		return problem->value(x);
+	}
+
+	double gradient(const VectorX &x, VectorX &grad){
+		if( n_gradient == 0 ){ last_iterate = x; }
+		else if( last_iterate.rows() == x.rows() && last_iterate == x ){ n_repeat_gradient++; }
+		n_gradient++;
+		return problem->gradient(x,grad);
+	}
+
+	void hessian(const VectorX &x, MatrixX &hess){ problem->hessian(x,hess); }
+
+	void solve_hessian(const VectorX &x, const VectorX &grad, VectorX &dx){
+		n_solve_hessian++;
+		problem->solve_hessian(x,grad,dx);
+	}
+
+	void hessian_vec(const VectorX &x, const VectorX &v, VectorX &Hv){ problem->hessian_vec(x,v,Hv); }
+};
+
+// Only the value of a problem, counting the evaluations,
+// so that the finite difference defaults are used
+class ValueProblem : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	mcl::optlib::Problem<double,Eigen::Dynamic> *problem;
+	int n_value;
+	ValueProblem( mcl::optlib::Problem<double,Eigen::Dynamic> *problem_ ) : problem(problem_), n_value(0) {}
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		return problem->converged(x0,x1,grad);
+	}
+	double value(const VectorX &x){
+		n_value++;
+		return problem->value(x);
+	}
+};
+
 class Rosenbrock : public mcl::optlib::Problem<double,2> {
 public:
 	typedef Eigen::Matrix<double,2,1> VectorX;
@@ -128,3 +360,314 @@ public:
 	// Test finite diff as well I guess
 };
 
+// Rosenbrock with x[0] <= 0.5, the minimum is at (0.5, 0.25)
+class BoxRosenbrock : public Rosenbrock {
+public:
+	bool bounds(VectorX &lower, VectorX &upper){
+		lower = VectorX(-2, -2);
+		upper = VectorX(0.5, 2);
+		return true;
+	}
+};
+
+// Rosenbrock that takes delay seconds per value, for testing Settings::max_time
+class SlowRosenbrock : public Rosenbrock {
+public:
+	double delay;
+	SlowRosenbrock( double delay_ ) : delay(delay_) {}
+	double value(const VectorX &x){
+		std::this_thread::sleep_for( std::chrono::duration<double>(delay) );
+		return Rosenbrock::value(x);
+	}
+};
+
+
+// Rosenbrock for float and double, with an analytic gradient
+template<typename Scalar>
+class RosenbrockT : public mcl::optlib::Problem<Scalar,2> {
+public:
+	typedef Eigen::Matrix<Scalar,2,1> VectorX;
+	Scalar tol; // gradient norm at convergence
+	RosenbrockT() : tol( std::sqrt(std::numeric_limits<Scalar>::epsilon()) ) {}
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < tol;
+	}
+	Scalar value(const VectorX &x){
+		Scalar a = 1 - x[0];
+		Scalar b = x[1] - x[0]*x[0];
+		return a*a + b*b*100;
+	}
+	Scalar gradient(const VectorX &x, VectorX &grad){
+		Scalar a = 1 - x[0];
+		Scalar b = x[1] - x[0]*x[0];
+		grad[0] = -2*a - 400*x[0]*b;
+		grad[1] = 200*b;
+		return a*a + b*b*100;
+	}
+};
+
+// Chained Rosenbrock sum_i (1-x_i)^2 + k (x_i+1 - x_i^2)^2, a narrow curved
+// valley that gets narrower with k, with an analytic gradient and hessian
+class ChainedRosenbrock : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	double k;
+	double tol; // gradient norm at convergence
+	ChainedRosenbrock( double k_ ) : k(k_), tol(1e-8) {}
+	void init(int dim, VectorX &x){
+		x = VectorX::Ones(dim);
+		for( int i=0; i<dim; i+=2 ){ x[i] = -1.2; }
+	}
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < tol;
+	}
+	double value(const VectorX &x){
+		double f = 0;
+		for( int i=0; i<x.rows()-1; ++i ){
+			double a = 1 - x[i];
+			double b = x[i+1] - x[i]*x[i];
+			f += a*a + k*b*b;
+		}
+		return f;
+	}
+	double gradient(const VectorX &x, VectorX &grad){
+		grad.setZero();
+		for( int i=0; i<x.rows()-1; ++i ){
+			double a = 1 - x[i];
+			double b = x[i+1] - x[i]*x[i];
+			grad[i] += -2*a - 4*k*x[i]*b;
+			grad[i+1] += 2*k*b;
+		}
+		return value(x);
+	}
+	void hessian(const VectorX &x, MatrixX &hess){
+		hess.setZero();
+		for( int i=0; i<x.rows()-1; ++i ){
+			double b = x[i+1] - x[i]*x[i];
+			hess(i,i) += 2 - 4*k*b + 8*k*x[i]*x[i];
+			hess(i,i+1) += -4*k*x[i];
+			hess(i+1,i) += -4*k*x[i];
+			hess(i+1,i+1) += 2*k;
+		}
+	}
+};
+
+// sum_i c_i x_i - log(x_i), minimized at x_i = 1/c_i. Infinite outside
+// x > 0, so full steps from init leave the domain of f.
+class LogBarrier : public mcl::optlib::Problem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	VectorX c;
+	double tol; // gradient norm at convergence
+	LogBarrier( int dim ) : c(dim), tol(1e-6) {
+		for( int i=0; i<dim; ++i ){ c[i] = 1.0 + 9.0*double(i)/double(std::max(1,dim-1)); }
+	}
+	void init(VectorX &x){ x = VectorX::Ones(c.rows()); }
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < tol;
+	}
+	double value(const VectorX &x){
+		if( !(x.minCoeff() > 0) ){ return std::numeric_limits<double>::infinity(); }
+		return c.dot(x) - x.array().log().sum();
+	}
+	double gradient(const VectorX &x, VectorX &grad){
+		grad = c - x.cwiseInverse();
+		return value(x);
+	}
+	void hessian(const VectorX &x, MatrixX &hess){
+		hess = x.array().square().inverse().matrix().asDiagonal();
+	}
+};
+
+// min 0.5 x^T A x - b^T x for float and double, with A diagonally dominant
+template<typename Scalar>
+class QuadT : public mcl::optlib::Problem<Scalar,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,Eigen::Dynamic> MatrixX;
+	MatrixX A;
+	VectorX b;
+	Scalar tol; // relative gradient norm at convergence
+	QuadT( int dim_ ) : tol( std::sqrt(std::numeric_limits<Scalar>::epsilon()) ) {
+		A = MatrixX::Random(dim_,dim_);
+		A = A.transpose() * A;
+		A.diagonal().array() += Scalar(dim_);
+		b = VectorX::Random(dim_);
+	}
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < tol * b.norm();
+	}
+	Scalar value(const VectorX &x){
+		return x.dot(A*x)/2 - b.dot(x);
+	}
+	Scalar gradient(const VectorX &x, VectorX &grad){
+		grad = A*x - b;
+		return x.dot(A*x)/2 - b.dot(x);
+	}
+	void hessian(const VectorX &x, MatrixX &hess){
+		(void)(x);
+		hess = A;
+	}
+};
+
+// QuadT with its own Newton solve (A is SPD), counting the calls
+template<typename Scalar>
+class LLTQuadT : public QuadT<Scalar> {
+public:
+	typedef Eigen::Matrix<Scalar,Eigen::Dynamic,1> VectorX;
+	int n_solve_hessian;
+	LLTQuadT( int dim_ ) : QuadT<Scalar>(dim_), n_solve_hessian(0) {}
+	void solve_hessian(const VectorX &x, const VectorX &grad, VectorX &dx){
+		(void)(x);
+		n_solve_hessian++;
+		dx = this->A.llt().solve(-grad);
+	}
+};
+
+// Same as Rosenbrock without virtual functions (see StaticProblem.hpp)
+class StaticRosenbrock : public mcl::optlib::StaticProblem<StaticRosenbrock,double,2> {
+public:
+	typedef Eigen::Matrix<double,2,1> VectorX;
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < 1e-10;
+	}
+	double value(const VectorX &x){
+		double a = 1.0 - x[0];
+		double b = x[1] - x[0]*x[0];
+		return a*a + b*b*100.0;
+	}
+};
+
+// Rosenbrock with auto-diff derivatives (see AutoDiffProblem.hpp)
+class ADRosenbrock : public mcl::optlib::AutoDiffProblem<ADRosenbrock,double,2> {
+public:
+	typedef Eigen::Matrix<double,2,1> VectorX;
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < 1e-10;
+	}
+	template<typename T>
+	T energy(const Eigen::Matrix<T,2,1> &x){
+		T a = 1.0 - x[0];
+		T b = x[1] - x[0]*x[0];
+		return a*a + b*b*100.0;
+	}
+};
+
+// Extended Rosenbrock (pairs of x) with reverse-mode auto-diff (see ReverseDiffProblem.hpp)
+class RDRosenbrock : public mcl::optlib::ReverseDiffProblem<double,Eigen::Dynamic> {
+public:
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VectorX;
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < 1e-10;
+	}
+	Var energy(const VarVec &x){
+		Var f = 0;
+		int n = x.size();
+		for( int i=0; i+1<n; i+=2 ){
+			Var a = 1.0 - x[i];
+			Var b = x[i+1] - x[i]*x[i];
+			f += a*a + b*b*100.0;
+		}
+		return f;
+	}
+	void analytic_gradient(const VectorX &x, VectorX &grad){
+		grad = VectorX::Zero(x.rows());
+		for( int i=0; i+1<x.rows(); i+=2 ){
+			double a = 1.0 - x[i];
+			double b = x[i+1] - x[i]*x[i];
+			grad[i] = -2.0*a - 400.0*x[i]*b;
+			grad[i+1] = 200.0*b;
+		}
+	}
+};
+
+// Uses every operation of ADVar
+class RDOps : public mcl::optlib::ReverseDiffProblem<double,2> {
+public:
+	typedef Eigen::Matrix<double,2,1> VectorX;
+	bool converged(const VectorX &x0, const VectorX &x1, const VectorX &grad){
+		(void)(x1); (void)(x0);
+		return grad.norm() < 1e-10;
+	}
+	Var energy(const VarVec &x){
+		Var f = sin(x[0])*cos(x[1]) + exp(x[0]/x[1]) + log(x[1]*x[1]);
+		f -= sqrt(x[0]*x[0] + 1.0) - pow(abs(x[1]), 1.5);
+		return -f;
+	}
+};
+
+// Rosenbrock with a minimum at (a_i, a_i^2) for problem i, solved in batches.
+// Uses the default finite difference hessians for Newton's.
+template<int LANES>
+class BatchRosenbrock : public mcl::optlib::BatchProblem<double,2,LANES> {
+public:
+	typedef mcl::optlib::BatchProblem<double,2,LANES> Base;
+	typedef typename Base::BatchX BatchX;
+	typedef typename Base::BatchS BatchS;
+	typedef typename Base::BatchI BatchI;
+	typedef typename Base::BatchB BatchB;
+
+	Eigen::ArrayXd a;
+	BatchRosenbrock( int n ){ a = Eigen::ArrayXd::LinSpaced(n, 0.5, 2.0); }
+
+	void converged(const BatchI &index, const BatchX &x0, const BatchX &x1, const BatchX &grad, BatchB &done){
+		(void)(index); (void)(x0); (void)(x1);
+		done = grad.square().rowwise().sum() < 1e-16;
+	}
+
+	void value(const BatchI &index, const BatchX &x, BatchS &fx){
+		BatchS ai;
+		for( int l=0; l<LANES; ++l ){ ai(l) = a(index(l)); }
+		BatchS u = ai - x.col(0);
+		BatchS v = x.col(1) - x.col(0).square();
+		fx = u*u + 100.0*v*v;
+	}
+
+	void gradient(const BatchI &index, const BatchX &x, BatchX &grad, BatchS &fx){
+		BatchS ai;
+		for( int l=0; l<LANES; ++l ){ ai(l) = a(index(l)); }
+		BatchS u = ai - x.col(0);
+		BatchS v = x.col(1) - x.col(0).square();
+		grad.col(0) = -2.0*u - 400.0*x.col(0)*v;
+		grad.col(1) = 200.0*v;
+		fx = u*u + 100.0*v*v;
+	}
+};
+
+// |x - (a_i, a_i)|^2 for problem i in any precision, with only a value,
+// so that the finite difference gradient and hessian are used
+template<typename Scalar, int LANES>
+class BatchSphere : public mcl::optlib::BatchProblem<Scalar,2,LANES> {
+public:
+	typedef mcl::optlib::BatchProblem<Scalar,2,LANES> Base;
+	typedef typename Base::BatchX BatchX;
+	typedef typename Base::BatchS BatchS;
+	typedef typename Base::BatchI BatchI;
+	typedef typename Base::BatchB BatchB;
+
+	Eigen::Array<Scalar,Eigen::Dynamic,1> a;
+	Scalar tol; // gradient norm at convergence
+	BatchSphere( int n ) : tol( std::sqrt(std::numeric_limits<Scalar>::epsilon()) ) {
+		a = Eigen::Array<Scalar,Eigen::Dynamic,1>::LinSpaced(n, Scalar(0.5), Scalar(2));
+	}
+
+	void converged(const BatchI &index, const BatchX &x0, const BatchX &x1, const BatchX &grad, BatchB &done){
+		(void)(index); (void)(x0); (void)(x1);
+		done = grad.square().rowwise().sum() < tol*tol;
+	}
+
+	void value(const BatchI &index, const BatchX &x, BatchS &fx){
+		BatchS ai;
+		for( int l=0; l<LANES; ++l ){ ai(l) = a(index(l)); }
+		fx = (x.col(0) - ai).square() + (x.col(1) - ai).square();
+	}
+};
@@ -0,0 +1,428 @@
+// The MIT License (MIT)
+// Copyright (c) 2017 Matt Overby
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include "BenchProblem.hpp"
+#include "TestProblem.hpp"
+#include "MCL/LBFGS.hpp"
+#include "MCL/LBFGSB.hpp"
+#include "MCL/TrustRegion.hpp"
+#include "MCL/Newton.hpp"
+#include "MCL/NewtonCG.hpp"
+#include "MCL/NonLinearCG.hpp"
+#include "MCL/BatchMinimizer.hpp"
+#include "MCL/ParallelBacktracking.hpp"
+
+using namespace mcl::optlib;
+typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+typedef std::chrono::high_resolution_clock Clock;
+
+static double elapsed_ms( const Clock::time_point &t0 ){
+	return std::chrono::duration<double,std::milli>( Clock::now() - t0 ).count();
+}
+
+// Time per iteration of L-BFGS for a history window M.
+// The two-loop recursion is O(M n), but updating the history
+// should not move any memory.
+template<int M>
+void bench_lbfgs_history( int dim ){
+
+	SeparableQuadratic problem(dim);
+	LBFGS<double,Eigen::Dynamic,M> solver;
+	solver.m_settings.max_iters = 100;
+
+	VecX x = VecX::Zero(dim);
+	solver.minimize( problem, x ); // sizes the buffers
+
+	// Cost of a gradient for reference
+	Clock::time_point t0 = Clock::now();
+	VecX grad = VecX::Zero(dim);
+	for( int i=0; i<10; ++i ){ problem.gradient( x, grad ); }
+	double grad_ms = elapsed_ms(t0) / 10.0;
+
+	x.setZero();
+	t0 = Clock::now();
+	int iters = solver.minimize( problem, x );
+	double iter_ms = elapsed_ms(t0) / std::max(iters,1);
+
+	// Memory a column-shifting history would have copied per iteration
+	double shift_mb = 2.0*(M-1)*dim*sizeof(double) / 1e6;
+	printf("%10d %4d %12.4f %12.2f %18.1f\n", dim, M, iter_ms, iter_ms/grad_ms, shift_mb);
+}
+
+void bench_lbfgs( int max_dim ){
+	std::cout << "\nL-BFGS history:" << std::endl;
+	printf("%10s %4s %12s %12s %18s\n", "dim", "M", "ms/iter", "iter/grad", "shift MB/iter");
+	for( int dim=1000; dim<=max_dim; dim*=10 ){
+		bench_lbfgs_history<4>(dim);
+		bench_lbfgs_history<8>(dim);
+		bench_lbfgs_history<16>(dim);
+		bench_lbfgs_history<32>(dim);
+	}
+}
+
+// Trust region subproblems on a problem with a sparse hessian.
+// DogLeg needs a factorization of the hessian every iteration (dense
+// or sparse), SteihaugCG only hessian-vector products.
+void bench_trustregion_method( int dim, const std::string &name, TRMethod method, bool sparse ){
+
+	QuarticChain problem(dim, sparse);
+	TrustRegion<double,Eigen::Dynamic> solver;
+	solver.m_settings.tr_method = method;
+	solver.m_settings.max_iters = 1000;
+
+	VecX x = VecX::Zero(dim);
+	Clock::time_point t0 = Clock::now();
+	solver.minimize( problem, x );
+	double ms = elapsed_ms(t0);
+
+	const SolveReport &r = solver.m_report;
+	printf("%10d %16s %12.2f %8d %8d %12s\n", dim, name.c_str(), ms, r.iters, r.cg_iters, termination_string(r.termination));
+}
+
+void bench_trustregion( int max_dim ){
+	std::cout << "\nTrust region subproblem:" << std::endl;
+	printf("%10s %16s %12s %8s %8s %12s\n", "dim", "method", "ms", "iters", "cg iters", "termination");
+	for( int dim=100; dim<=max_dim; dim*=10 ){
+		if( dim <= 1000 ){ bench_trustregion_method( dim, "dogleg (dense)", TRMethod::DogLeg, false ); }
+		bench_trustregion_method( dim, "dogleg (sparse)", TRMethod::DogLeg, true );
+		bench_trustregion_method( dim, "steihaug", TRMethod::SteihaugCG, true );
+	}
+}
+
+// Throughput of many tiny problems, one at a time through Minimizer
+// and in SIMD batches through BatchMinimizer
+template<typename Solver>
+double bench_small_scalar( const Eigen::ArrayXd &c, Solver &solver ){
+	SmallQuartic problem;
+	Clock::time_point t0 = Clock::now();
+	for( int i=0; i<c.size(); ++i ){
+		problem.c = c[i];
+		Eigen::Vector3d x = Eigen::Vector3d::Zero();
+		solver.minimize( problem, x );
+	}
+	return elapsed_ms(t0);
+}
+
+template<int LANES>
+double bench_small_batch( const Eigen::ArrayXd &c, BatchMethod method, int threads ){
+	typedef BatchMinimizer<double,3,LANES> BatchMin;
+	BatchSmallQuartic<LANES> problem(c);
+	BatchMin solver;
+	solver.m_settings.method = method;
+	solver.m_settings.threads = threads;
+	typename BatchMin::MatXN X = BatchMin::MatXN::Zero(3,c.size());
+	Clock::time_point t0 = Clock::now();
+	solver.minimize( problem, X );
+	return elapsed_ms(t0);
+}
+
+void bench_batch( int n ){
+	std::cout << "\nBatch of " << n << " problems (DIM = 3):" << std::endl;
+	printf("%24s %12s %16s\n", "method", "ms", "solves/s");
+	Eigen::ArrayXd c = Eigen::ArrayXd::Random(n);
+	auto row = [&]( const char *name, double ms ){ printf("%24s %12.2f %16.0f\n", name, ms, n / (ms*1e-3)); };
+
+	LBFGS<double,3,4> lbfgs;
+	Newton<double,3> newton;
+	lbfgs.m_settings.ls_method = LSMethod::Backtracking;
+	newton.m_settings.ls_method = LSMethod::Backtracking;
+	row( "lbfgs (scalar)", bench_small_scalar(c, lbfgs) );
+	row( "newton (scalar)", bench_small_scalar(c, newton) );
+	row( "lbfgs (batch 4)", bench_small_batch<4>(c, BatchMethod::LBFGS, 1) );
+	row( "lbfgs (batch 8)", bench_small_batch<8>(c, BatchMethod::LBFGS, 1) );
+	row( "newton (batch 8)", bench_small_batch<8>(c, BatchMethod::Newton, 1) );
+	row( "newton (batch 8, mt)", bench_small_batch<8>(c, BatchMethod::Newton, 0) );
+}
+
+// Rosenbrock (TestProblem.hpp) through the virtual Problem and the StaticProblem.
+// Both use finite difference gradients, so most of the time is spent in value().
+template<typename Solver>
+void bench_static_solver( const std::string &name, int n ){
+	Solver solver;
+	solver.m_settings.max_iters = 1000;
+	Rosenbrock rb;
+	StaticRosenbrock srb;
+	Problem<double,2> &rb_virtual = rb;
+
+	Clock::time_point t0 = Clock::now();
+	for( int i=0; i<n; ++i ){
+		Eigen::Vector2d x = Eigen::Vector2d::Zero();
+		solver.minimize( rb_virtual, x );
+	}
+	double virtual_ms = elapsed_ms(t0);
+
+	t0 = Clock::now();
+	for( int i=0; i<n; ++i ){
+		Eigen::Vector2d x = Eigen::Vector2d::Zero();
+		solver.minimize( srb, x );
+	}
+	double static_ms = elapsed_ms(t0);
+	printf("%16s %12.2f %12.2f %10.2f\n", name.c_str(), virtual_ms, static_ms, virtual_ms/static_ms);
+}
+
+void bench_static( int n ){
+	std::cout << "\nVirtual vs static Rosenbrock (" << n << " solves):" << std::endl;
+	printf("%16s %12s %12s %10s\n", "solver", "virtual ms", "static ms", "speedup");
+	bench_static_solver< LBFGS<double,2> >( "lbfgs", n );
+	bench_static_solver< Newton<double,2> >( "newton", n );
+	bench_static_solver< TrustRegion<double,2> >( "trustregion", n );
+}
+
+// Box constraints given to LBFGSB versus a stiff penalty with LBFGS.
+// The penalty worsens the conditioning and still violates the bounds.
+template<typename Solver>
+void bench_bounds_solver( int dim, double penalty, Solver &solver ){
+	BoxTridiagonal problem(dim, penalty);
+	solver.m_settings.max_iters = 100000;
+	solver.m_settings.ls_max_iters = 100;
+	VecX x = VecX::Zero(dim);
+	Clock::time_point t0 = Clock::now();
+	solver.minimize( problem, x );
+	double ms = elapsed_ms(t0);
+	const SolveReport &r = solver.m_report;
+	printf("%10d %16s %12.2f %8d %10d %12.2e %12s\n", dim, problem.name().c_str(), ms, r.iters,
+		r.gradient_calls, problem.violation(x).template lpNorm<Eigen::Infinity>(), termination_string(r.termination));
+}
+
+void bench_bounds( int max_dim ){
+	std::cout << "\nBox constraints:" << std::endl;
+	printf("%10s %16s %12s %8s %10s %12s %12s\n", "dim", "method", "ms", "iters", "gradients", "violation", "termination");
+	for( int dim=100; dim<=max_dim; dim*=10 ){
+		LBFGS<double,Eigen::Dynamic> lbfgs;
+		LBFGSB<double,Eigen::Dynamic> lbfgsb;
+		lbfgs.m_settings.ls_method = LSMethod::Backtracking;
+		bench_bounds_solver( dim, 1e4, lbfgs );
+		bench_bounds_solver( dim, 0, lbfgsb );
+	}
+}
+
+// Backtracking versus ParallelBacktracking on a problem whose
+// evaluations take 1ms, the time is mostly spent waiting on value(x).
+template<typename Solver>
+void bench_parallel_ls_solver( const std::string &name, int threads ){
+	SlowExtendedRosenbrock problem(100, 1000);
+	Solver solver;
+	solver.m_settings.max_iters = 50;
+	solver.m_settings.ls_threads = threads;
+	VecX x;
+	problem.init(x);
+	Clock::time_point t0 = Clock::now();
+	solver.minimize( problem, x );
+	double ms = elapsed_ms(t0);
+	const SolveReport &r = solver.m_report;
+	printf("%12s %8d %12.2f %8d %10d %10d\n", name.c_str(), threads, ms, r.iters, r.value_calls, r.gradient_calls);
+}
+
+void bench_parallel_ls(){
+	std::cout << "\nParallel line search (1ms per evaluation):" << std::endl;
+	printf("%12s %8s %12s %8s %10s %10s\n", "solver", "threads", "ms", "iters", "values", "gradients");
+	const int threads[4] = { 1, 2, 4, 8 };
+	bench_parallel_ls_solver< NonLinearCG<double,Eigen::Dynamic,Backtracking> >( "cg serial", 1 );
+	for( int t=0; t<4; ++t ){
+		bench_parallel_ls_solver< NonLinearCG<double,Eigen::Dynamic,ParallelBacktracking> >( "cg", threads[t] );
+	}
+	bench_parallel_ls_solver< LBFGS<double,Eigen::Dynamic,8,Backtracking> >( "lbfgs serial", 1 );
+	for( int t=0; t<4; ++t ){
+		bench_parallel_ls_solver< LBFGS<double,Eigen::Dynamic,8,ParallelBacktracking> >( "lbfgs", threads[t] );
+	}
+}
+
+static const char* ls_string( LSMethod m ){
+	switch( m ){
+		case LSMethod::None: return "none";
+		case LSMethod::MoreThuente: return "morethuente";
+		case LSMethod::Backtracking: return "backtracking";
+		case LSMethod::BacktrackingCubic: return "backtrackingcubic";
+		case LSMethod::WeakWolfeBisection: return "bisection";
+		case LSMethod::HagerZhang: return "hagerzhang";
+		case LSMethod::ParallelBacktracking: return "parallelbacktracking";
+		case LSMethod::Nonmonotone: return "nonmonotone";
+	}
+	return "unknown";
+}
+
+static const char* tr_string( TRMethod m ){
+	switch( m ){
+		case TRMethod::CauchyPoint: return "cauchypoint";
+		case TRMethod::DogLeg: return "dogleg";
+		case TRMethod::SteihaugCG: return "steihaug";
+	}
+	return "unknown";
+}
+
+// JSON has no inf or NaN
+static void json_number( FILE *f, const char *key, double v ){
+	if( std::isfinite(v) ){ fprintf(f, "\"%s\": %.9g", key, v); }
+	else{ fprintf(f, "\"%s\": null", key); }
+}
+
+// One solve of the suite. Times are ms, counts are zero if !MCL_SOLVE_REPORT.
+// Newton's only calls solve_hessian, whose default evaluates the hessian inside
+// the problem, so its hessians are the "solve" (solve_hessian_calls) column.
+struct SuiteRun {
+	std::string problem, solver, ls_method, tr_method;
+	int dim;
+	double ms, fx, grad_norm;
+	SolveReport report;
+
+	void print() const {
+		const SolveReport &r = report;
+		printf("%12s %8d %12s %18s %8.1f %6d %6d %6d %6d %6d %6d %10.3e %s\n", problem.c_str(), dim, solver.c_str(),
+			(ls_method.empty() ? tr_method : ls_method).c_str(), ms, r.iters, r.value_calls, r.gradient_calls,
+			r.hessian_calls, r.solve_hessian_calls, r.hessian_vec_calls, grad_norm, termination_string(r.termination));
+	}
+
+	void write( FILE *f ) const {
+		const SolveReport &r = report;
+		fprintf(f, "\t\t{\"problem\": \"%s\", \"dim\": %d, \"solver\": \"%s\", ", problem.c_str(), dim, solver.c_str());
+		if( ls_method.empty() ){ fprintf(f, "\"ls_method\": null, "); }
+		else{ fprintf(f, "\"ls_method\": \"%s\", ", ls_method.c_str()); }
+		if( tr_method.empty() ){ fprintf(f, "\"tr_method\": null, "); }
+		else{ fprintf(f, "\"tr_method\": \"%s\", ", tr_method.c_str()); }
+		fprintf(f, "\"termination\": \"%s\", ", termination_string(r.termination));
+		json_number(f, "time_ms", ms); fprintf(f, ", ");
+		fprintf(f, "\"iters\": %d, \"ls_iters\": %d, \"cg_iters\": %d, \"tr_rejected\": %d, ", r.iters, r.ls_iters, r.cg_iters, r.tr_rejected);
+		fprintf(f, "\"value_calls\": %d, \"gradient_calls\": %d, \"hessian_calls\": %d, \"solve_hessian_calls\": %d, \"hessian_vec_calls\": %d, ",
+			r.value_calls, r.gradient_calls, r.hessian_calls, r.solve_hessian_calls, r.hessian_vec_calls);
+		json_number(f, "fx", fx); fprintf(f, ", ");
+		json_number(f, "grad_norm", grad_norm);
+		fprintf(f, "}");
+	}
+};
+
+// Solves the problem from its starting point, then evaluates the final gradient
+// outside of the solver so it is not counted in the report.
+SuiteRun run_suite( SuiteProblem &problem, Minimizer<double,Eigen::Dynamic> &solver,
+	const std::string &solver_name, const std::string &ls, const std::string &tr ){
+	SuiteRun run;
+	run.problem = problem.name();
+	run.solver = solver_name;
+	run.ls_method = ls;
+	run.tr_method = tr;
+	run.dim = problem.dim();
+
+	VecX x;
+	problem.init(x);
+	Clock::time_point t0 = Clock::now();
+	solver.minimize( problem, x );
+	run.ms = elapsed_ms(t0);
+	run.report = solver.m_report;
+
+	VecX grad = VecX::Zero(x.rows());
+	run.fx = problem.gradient( x, grad );
+	run.grad_norm = grad.norm();
+	return run;
+}
+
+// Every solver x LSMethod (and TrustRegion x TRMethod) on every suite problem,
+// at sizes 10, 100, ... up to max_dim. Written as JSON to json_file.
+void bench_suite( int max_dim, const std::string &json_file ){
+	const int max_iters = 1000;
+	const int ls_max_iters = 100;
+	const LSMethod ls_methods[] = { LSMethod::None, LSMethod::MoreThuente, LSMethod::Backtracking,
+		LSMethod::BacktrackingCubic, LSMethod::WeakWolfeBisection, LSMethod::HagerZhang,
+		LSMethod::ParallelBacktracking, LSMethod::Nonmonotone };
+	const TRMethod tr_methods[] = { TRMethod::CauchyPoint, TRMethod::DogLeg, TRMethod::SteihaugCG };
+
+	typedef std::unique_ptr< Minimizer<double,Eigen::Dynamic> > MinPtr;
+	std::vector< std::pair<std::string,MinPtr> > ls_solvers;
+	ls_solvers.emplace_back( "lbfgs", MinPtr(new LBFGS<double,Eigen::Dynamic>()) );
+	ls_solvers.emplace_back( "cg", MinPtr(new NonLinearCG<double,Eigen::Dynamic>()) );
+	ls_solvers.emplace_back( "newton", MinPtr(new Newton<double,Eigen::Dynamic>()) );
+	ls_solvers.emplace_back( "newtoncg", MinPtr(new NewtonCG<double,Eigen::Dynamic>()) );
+	TrustRegion<double,Eigen::Dynamic> trustregion;
+	trustregion.m_settings.max_iters = max_iters;
+
+	std::cout << "\nSuite:" << std::endl;
+	printf("%12s %8s %12s %18s %8s %6s %6s %6s %6s %6s %6s %10s %s\n", "problem", "dim", "solver", "method",
+		"ms", "iters", "value", "grad", "hess", "solve", "Hv", "|grad|", "termination");
+
+	std::vector<SuiteRun> runs;
+	for( int dim=10; dim<=max_dim; dim*=10 ){
+		std::vector< std::unique_ptr<SuiteProblem> > problems;
+		problems.emplace_back( new ExtendedRosenbrock(dim) );
+		problems.emplace_back( new ExtendedPowell(dim) );
+		problems.emplace_back( new TridiagonalQuadratic(dim) );
+		problems.emplace_back( new MassSpringChain(dim) );
+		problems.emplace_back( new NeoHookeanPatch(dim) );
+
+		for( size_t p=0; p<problems.size(); ++p ){
+			SuiteProblem &problem = *problems[p];
+			for( size_t s=0; s<ls_solvers.size(); ++s ){
+				Minimizer<double,Eigen::Dynamic> &solver = *ls_solvers[s].second;
+				solver.m_settings.max_iters = max_iters;
+				solver.m_settings.ls_max_iters = ls_max_iters;
+				for( LSMethod ls : ls_methods ){
+					solver.m_settings.ls_method = ls;
+					runs.emplace_back( run_suite( problem, solver, ls_solvers[s].first, ls_string(ls), "" ) );
+					runs.back().print();
+				}
+			}
+			for( TRMethod tr : tr_methods ){
+				trustregion.m_settings.tr_method = tr;
+				runs.emplace_back( run_suite( problem, trustregion, "trustregion", "", tr_string(tr) ) );
+				runs.back().print();
+			}
+		}
+	}
+
+	FILE *f = fopen( json_file.c_str(), "w" );
+	if( !f ){
+		std::cerr << "Could not open " << json_file << std::endl;
+		return;
+	}
+	fprintf(f, "{\n\t\"solve_report\": %d,\n\t\"max_iters\": %d,\n\t\"runs\": [\n", MCL_SOLVE_REPORT, max_iters);
+	for( size_t i=0; i<runs.size(); ++i ){
+		runs[i].write(f);
+		fprintf(f, i+1 < runs.size() ? ",\n" : "\n");
+	}
+	fprintf(f, "\t]\n}\n");
+	fclose(f);
+	std::cout << "Wrote " << runs.size() << " runs to " << json_file << std::endl;
+}
+
+int main(int argc, char *argv[] ){
+	srand(100);
+	std::string mode = "all";
+	int max_dim = 100000;
+	if( argc > 1 ){ mode = std::string(argv[1]); }
+	if( argc > 2 ){ max_dim = std::stoi(argv[2]); }
+	std::string json_file = "bench.json";
+	if( argc > 3 ){ json_file = std::string(argv[3]); }
+
+	if( mode=="lbfgs" || mode=="all" ){ bench_lbfgs( max_dim ); }
+	if( mode=="trustregion" || mode=="all" ){ bench_trustregion( max_dim ); }
+	if( mode=="batch" || mode=="all" ){ bench_batch( 10*max_dim ); }
+	if( mode=="static" || mode=="all" ){ bench_static( max_dim / 10 ); }
+	if( mode=="bounds" || mode=="all" ){ bench_bounds( max_dim ); }
+	if( mode=="linesearch" ){ bench_parallel_ls(); }
+	if( mode=="suite" ){ bench_suite( max_dim, json_file ); }
+
+	return EXIT_SUCCESS;
+}
@@ -19,14 +19,25 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+// Enables Eigen::internal::set_is_malloc_allowed, see test_malloc
+#define EIGEN_RUNTIME_NO_MALLOC
+
+#include <algorithm>
 #include <iostream>
 #include "TestProblem.hpp"
 #include "MCL/LBFGS.hpp"
+#include "MCL/LBFGSB.hpp"
 #include "MCL/NonLinearCG.hpp"
 #include "MCL/Newton.hpp"
+#include "MCL/NewtonCG.hpp"
 #include "MCL/TrustRegion.hpp"
+#include "MCL/BatchMinimizer.hpp"
+#include "MCL/ParallelSolve.hpp"
+#include "MCL/MixedProblem.hpp"
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <chrono>
 
 using namespace mcl::optlib;
 typedef std::shared_ptr< Minimizer<double,2> > MinPtr2; // rb
@@ -161,6 +172,1217 @@ bool test_zero( std::vector<MinPtrD> &solvers, std::vector<std::string> &names )
 
 	} // end loop solvers
 
+	// A step onto a zero gradient should stop NewtonCG, even if
+	// converged() never returns true (the forcing term would be 0/0)
+	if( std::find( names.begin(), names.end(), "newtoncg" ) != names.end() ){
+		IdentityQuadProblem iq;
+		NewtonCG<double,Eigen::Dynamic> solver;
+		solver.m_settings.max_iters = 5;
+		VecX x = VecX::Ones(4);
+		solver.minimize( iq, x );
+		if( solver.m_report.termination != Termination::Converged || !x.allFinite() || x.norm() > 0 ){
+			std::cerr << "(newtoncg) Zero gradient: " << termination_string(solver.m_report.termination) <<
+				", x = " << x.transpose() << std::endl;
+			success = false;
+		}
+		else{ std::cout << "(newtoncg) Zero gradient: Success" << std::endl; }
+	}
+
+	return success;
+}
+
+
+// Test the sparse hessian path of Newton's and TrustRegion,
+// and NewtonCG with hessian-vector products
+bool test_sparse( std::vector<MinPtrD> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest sparse:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 1000; // would be slow with dense hessians
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+		if( names[i] != "newton" && names[i] != "trustregion" && names[i] != "newtoncg" && names[i] != "steihaug" ){ continue; }
+		bool curr_success = true;
+
+		// Analytic, then finite difference hessians
+		for( int fd=0; fd<2; ++fd ){
+
+			// Quadratic, Newton's should converge in 1 iter
+			SparseProblem sp(dim);
+			sp.fd_hessian = fd;
+			solvers[i]->m_settings.max_iters = names[i] == "newton" ? 1 : 100;
+			solvers[i]->m_settings.verbose = 1;
+			VecX x = VecX::Zero(dim);
+			solvers[i]->minimize( sp, x );
+
+			// Run again to make sure the analyzed pattern is reused
+			x.setZero();
+			solvers[i]->minimize( sp, x );
+
+			VecX r = sp.A*x - sp.b;
+			double rn = r.norm();
+			if( rn > 1e-8 ){
+				std::cerr << "(" << names[i] << ") Failed to minimize (fd " << fd << "): |Ax-b| = " << rn << std::endl;
+				curr_success = false;
+			}
+		}
+
+		if( curr_success ){ std::cout << "(" << names[i] << ") Sparse (" << dim << "): Success" << std::endl; }
+		else{ success = false; }
+	}
+
+	return success;
+}
+
+
+// Solve Rosenbrock through the virtual Problem and the StaticProblem
+// interfaces, which should give the same result.
+template<typename Solver>
+bool test_static_solver( const std::string &name ){
+	Solver s_virtual, s_static;
+	s_virtual.m_settings.max_iters = 1000;
+	s_static.m_settings.max_iters = 1000;
+	Rosenbrock rb;
+	StaticRosenbrock srb;
+	Eigen::Vector2d x_virtual = Eigen::Vector2d::Zero();
+	Eigen::Vector2d x_static = Eigen::Vector2d::Zero();
+	int iters_virtual = s_virtual.minimize( static_cast< Problem<double,2>& >(rb), x_virtual );
+	int iters_static = s_static.minimize( srb, x_static );
+	if( iters_virtual != iters_static || x_virtual != x_static ||
+		s_virtual.m_report.value_calls != s_static.m_report.value_calls ){
+		std::cerr << "(" << name << ") Static: " << iters_static << " iters, virtual: " << iters_virtual << std::endl;
+		return false;
+	}
+	std::cout << "(" << name << ") Static: Success" << std::endl;
+	return true;
+}
+
+bool test_static( std::vector<std::string> &names ){
+	std::cout << "\nTest static problem:" << std::endl;
+	bool success = true;
+	for( size_t i=0; i<names.size(); ++i ){
+		if( names[i] == "lbfgs" ){ success &= test_static_solver< LBFGS<double,2> >( names[i] ); }
+		if( names[i] == "lbfgsb" ){ success &= test_static_solver< LBFGSB<double,2> >( names[i] ); }
+		if( names[i] == "cg" ){ success &= test_static_solver< NonLinearCG<double,2> >( names[i] ); }
+		if( names[i] == "newton" ){ success &= test_static_solver< Newton<double,2> >( names[i] ); }
+		if( names[i] == "newtoncg" ){ success &= test_static_solver< NewtonCG<double,2> >( names[i] ); }
+		if( names[i] == "trustregion" ){ success &= test_static_solver< TrustRegion<double,2> >( names[i] ); }
+	}
+	return success;
+}
+
+
+// A solver with a compile-time line search policy should give the
+// same result as the default solver with the matching ls_method.
+template<typename Runtime, typename Policy>
+bool test_policy_solver( const std::string &name, LSMethod ls_method ){
+	Runtime s_runtime;
+	Policy s_policy;
+	s_runtime.m_settings.max_iters = 1000;
+	s_runtime.m_settings.ls_method = ls_method;
+	s_policy.m_settings.max_iters = 1000;
+	s_policy.m_settings.ls_method = LSMethod::None; // ignored by the policy
+	Rosenbrock rb;
+	Eigen::Vector2d x_runtime = Eigen::Vector2d::Zero();
+	Eigen::Vector2d x_policy = Eigen::Vector2d::Zero();
+	int iters_runtime = s_runtime.minimize( rb, x_runtime );
+	int iters_policy = s_policy.minimize( rb, x_policy );
+	if( iters_runtime != iters_policy || x_runtime != x_policy ||
+		s_runtime.m_report.ls_iters != s_policy.m_report.ls_iters ){
+		std::cerr << "(" << name << ") Line search policy: " << iters_policy << " iters, runtime: " << iters_runtime << std::endl;
+		return false;
+	}
+	std::cout << "(" << name << ") Line search policy: Success" << std::endl;
+	return true;
+}
+
+bool test_policy( std::vector<std::string> &names ){
+	std::cout << "\nTest line search policy:" << std::endl;
+	bool success = true;
+	for( size_t i=0; i<names.size(); ++i ){
+		if( names[i] == "lbfgs" ){ success &= test_policy_solver< LBFGS<double,2>, LBFGS<double,2,8,MoreThuente> >( names[i], LSMethod::MoreThuente ); }
+		if( names[i] == "cg" ){ success &= test_policy_solver< NonLinearCG<double,2>, NonLinearCG<double,2,Backtracking> >( names[i], LSMethod::Backtracking ); }
+		if( names[i] == "newton" ){ success &= test_policy_solver< Newton<double,2>, Newton<double,2,NoLineSearch> >( names[i], LSMethod::None ); }
+		if( names[i] == "newtoncg" ){ success &= test_policy_solver< NewtonCG<double,2>, NewtonCG<double,2,MoreThuente> >( names[i], LSMethod::MoreThuente ); }
+	}
+	return success;
+}
+
+
+// Test that solvers do not allocate once their buffers have been sized.
+// Eigen asserts if a heap allocation happens while malloc is not allowed.
+bool test_malloc( std::vector<MinPtrD> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest malloc:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	int dim = 16;
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+
+		QuadProblem qp(dim);
+		solvers[i]->m_settings.max_iters = 100;
+		solvers[i]->m_settings.verbose = 1;
+		VecX x = VecX::Zero(dim);
+		solvers[i]->minimize( qp, x ); // first call sizes the buffers
+
+		x.setZero();
+		Eigen::internal::set_is_malloc_allowed(false);
+		solvers[i]->minimize( qp, x );
+		Eigen::internal::set_is_malloc_allowed(true);
+
+		std::cout << "(" << names[i] << ") Malloc (" << dim << "): Success" << std::endl;
+	}
+
+	return true;
+}
+
+
+// Test warm started L-BFGS on a sequence of similar problems
+bool test_warmstart( std::vector<std::string> &names ){
+
+	if( std::find( names.begin(), names.end(), "lbfgs" ) == names.end() ){ return true; }
+	std::cout << "\nTest warm start:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 4; // small enough for the history to capture the hessian
+
+	QuadProblem qp(dim);
+	qp.tol = 1e-6;
+	LBFGS<double,Eigen::Dynamic> cold, warm;
+	cold.m_settings.max_iters = 200;
+	warm.m_settings.max_iters = 200;
+	warm.warm_start = true;
+
+	VecX x_cold = VecX::Zero(dim);
+	VecX x_warm = VecX::Zero(dim);
+	int iters_cold = 0, iters_warm = 0;
+	for( int frame=0; frame<10; ++frame ){
+		qp.b += 0.01 * VecX::Random(dim);
+		iters_cold += cold.minimize( qp, x_cold );
+		iters_warm += warm.minimize( qp, x_warm );
+		double rn = (qp.A*x_warm - qp.b).norm();
+		if( rn > 1e-5 ){
+			std::cerr << "(lbfgs) Failed to minimize with warm start: |Ax-b| = " << rn << std::endl;
+			success = false;
+		}
+	}
+
+	if( iters_warm >= iters_cold ){
+		std::cerr << "(lbfgs) Warm start used " << iters_warm << " iters, cold start " << iters_cold << std::endl;
+		success = false;
+	}
+
+	warm.reset_history();
+	if( warm.history_size() != 0 ){
+		std::cerr << "(lbfgs) History not cleared by reset_history" << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "(lbfgs) Warm start (" << iters_warm << " vs " << iters_cold << " iters): Success" << std::endl; }
+	return success;
+}
+
+
+// Test that line searches reuse the value and gradient the solver already
+// has, and that the solver reuses the gradient at the accepted point.
+bool test_evals( std::vector<MinPtrD> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest evaluations:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 16;
+
+	std::vector<LSMethod> methods = { LSMethod::None, LSMethod::MoreThuente,
+		LSMethod::Backtracking, LSMethod::BacktrackingCubic, LSMethod::WeakWolfeBisection, LSMethod::HagerZhang, LSMethod::Nonmonotone };
+	std::vector<std::string> method_names = { "none", "morethuente",
+		"backtracking", "backtrackingcubic", "weakwolfebisection", "hagerzhang", "nonmonotone" };
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+		if( names[i] == "trustregion" || names[i] == "steihaug" ){ continue; } // no line search
+		bool curr_success = true;
+
+		int n_methods = methods.size();
+		for( int j=0; j<n_methods; ++j ){
+			QuadProblem qp(dim);
+			CountProblem cp(&qp);
+			solvers[i]->m_settings.max_iters = 10;
+			solvers[i]->m_settings.verbose = 0;
+			solvers[i]->m_settings.ls_method = methods[j];
+			VecX x = VecX::Zero(dim);
+			solvers[i]->minimize( cp, x );
+			if( cp.n_repeat_gradient > 0 ){
+				std::cerr << "(" << names[i] << ") " << method_names[j] << ": " << cp.n_repeat_gradient <<
+					" of " << cp.n_gradient << " gradients were re-evaluated at a known iterate" << std::endl;
+				curr_success = false;
+			}
+		}
+		solvers[i]->m_settings.ls_method = Minimizer<double,Eigen::Dynamic>::Settings().ls_method;
+
+		if( curr_success ){ std::cout << "(" << names[i] << ") Evaluations: Success" << std::endl; }
+		else{ success = false; }
+	}
+
+	return success;
+}
+
+
+// A user solver that only implements solve(Problem&), which
+// must compile and run whether or not MCL_SOLVE_REPORT is set
+class StepMinimizer : public Minimizer<double,Eigen::Dynamic> {
+public:
+	std::unique_ptr< Minimizer<double,Eigen::Dynamic> > clone() const {
+		return std::unique_ptr< Minimizer<double,Eigen::Dynamic> >( new StepMinimizer(*this) );
+	}
+protected:
+	int solve(Problem<double,Eigen::Dynamic> &problem, VecX &x){
+		VecX grad = VecX::Zero(x.rows());
+		problem.gradient(x, grad);
+		x -= 1e-3*grad;
+		m_report.iters = 1;
+		m_report.termination = Termination::MaxIters;
+		return 1;
+	}
+};
+
+// A user solver written against the old interface, which overrides minimize
+// and nothing else. Must still compile and run.
+class LegacyStepMinimizer : public Minimizer<double,Eigen::Dynamic> {
+public:
+	int minimize(Problem<double,Eigen::Dynamic> &problem, VecX &x){
+		VecX grad = VecX::Zero(x.rows());
+		problem.gradient(x, grad);
+		x -= 1e-3*grad;
+		return 1;
+	}
+};
+
+// Test the SolveReport counts against the evaluations seen by the problem
+bool test_report( std::vector<MinPtrD> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest report:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 16;
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+		bool curr_success = true;
+
+		QuadProblem qp(dim);
+		qp.tol = 1e-6;
+		CountProblem cp(&qp);
+		solvers[i]->m_settings.max_iters = 1000;
+		solvers[i]->m_settings.verbose = 1;
+		VecX x = VecX::Zero(dim);
+		int iters = solvers[i]->minimize( cp, x );
+		const SolveReport &report = solvers[i]->m_report;
+
+		if( report.iters != iters ){
+			std::cerr << "(" << names[i] << ") Report iters " << report.iters << " != " << iters << std::endl;
+			curr_success = false;
+		}
+		if( report.termination != Termination::Converged ){
+			std::cerr << "(" << names[i] << ") Bad termination: " << termination_string(report.termination) << std::endl;
+			curr_success = false;
+		}
+		bool has_ls = names[i] != "trustregion" && names[i] != "steihaug";
+		if( has_ls && report.ls_iters < iters ){
+			std::cerr << "(" << names[i] << ") Too few line search iters: " << report.ls_iters << std::endl;
+			curr_success = false;
+		}
+		if( names[i] == "trustregion" && cp.n_solve_hessian == 0 ){
+			std::cerr << "(" << names[i] << ") Overridden solve_hessian was not used" << std::endl;
+			curr_success = false;
+		}
+#if MCL_SOLVE_REPORT
+		if( report.value_calls != cp.n_value || report.gradient_calls != cp.n_gradient ){
+			std::cerr << "(" << names[i] << ") Report counted " << report.value_calls << " values and " <<
+				report.gradient_calls << " gradients, expected " << cp.n_value << " and " << cp.n_gradient << std::endl;
+			curr_success = false;
+		}
+		if( report.hessian_calls > report.iters - report.tr_rejected + 1 ){
+			std::cerr << "(" << names[i] << ") Too many hessians: " << report.hessian_calls << std::endl;
+			curr_success = false;
+		}
+		if( report.total_time < report.problem_time() ){
+			std::cerr << "(" << names[i] << ") Total time less than problem time" << std::endl;
+			curr_success = false;
+		}
+#endif
+
+		if( curr_success ){ std::cout << "(" << names[i] << ") Report: Success" << std::endl; }
+		else{ success = false; }
+	}
+
+	StepMinimizer step;
+	QuadProblem qp(dim);
+	VecX x = VecX::Zero(dim);
+	if( step.minimize( qp, x ) != 1 || step.m_report.iters != 1 || x.norm() <= 0 ){
+		std::cerr << "(user solver) Failed to minimize with only solve(Problem&)" << std::endl;
+		success = false;
+	}
+
+	LegacyStepMinimizer legacy;
+	Minimizer<double,Eigen::Dynamic> &legacy_base = legacy;
+	x.setZero();
+	if( legacy_base.minimize( qp, x ) != 1 || x.norm() <= 0 ){
+		std::cerr << "(user solver) Failed to minimize with an overridden minimize" << std::endl;
+		success = false;
+	}
+
+	return success;
+}
+
+
+// Compare finite difference gradients to the analytic gradient
+bool test_finitediff(){
+
+	std::cout << "\nTest finite differences:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 64;
+
+	SparseProblem sp(dim);
+	VecX x = VecX::Random(dim);
+	VecX grad, fd_grad, fd_grad_par;
+	sp.gradient(x, grad);
+
+	for( int accuracy=0; accuracy<4; ++accuracy ){
+		sp.m_fd.m_settings.accuracy = accuracy;
+		sp.m_fd.m_settings.thread_safe = false;
+		sp.finiteGradient(x, fd_grad);
+		double err = (fd_grad-grad).norm() / grad.norm();
+		if( err > 1e-6 ){
+			std::cerr << "(accuracy " << accuracy << ") Finite gradient error: " << err << std::endl;
+			success = false;
+		}
+
+		// Same stencil on each coordinate, so the result must match exactly
+		sp.m_fd.m_settings.thread_safe = true;
+		sp.m_fd.m_settings.threads = 4;
+		sp.finiteGradient(x, fd_grad_par);
+		if( fd_grad_par != fd_grad ){
+			std::cerr << "(accuracy " << accuracy << ") Parallel finite gradient differs from serial" << std::endl;
+			success = false;
+		}
+	}
+
+	// Dense hessian, 2 gradients per column
+	typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> MatX;
+	CountProblem cp(&sp);
+	MatX hess;
+	cp.finiteHessian(x, hess);
+	double err = (hess-MatX(sp.A)).norm() / sp.A.norm();
+	if( err > 1e-6 || cp.n_gradient != 2*dim || hess != hess.transpose() ){
+		std::cerr << "Finite hessian error: " << err << " with " << cp.n_gradient << " gradients" << std::endl;
+		success = false;
+	}
+
+	// With only a value, second differences of the value, 2n^2+1 values
+	ValueProblem vp(&sp);
+	vp.gradient(x, fd_grad);
+	vp.n_value = 0;
+	vp.finiteHessian(x, hess);
+	err = (hess-MatX(sp.A)).norm() / sp.A.norm();
+	if( err > 1e-4 || vp.n_value != 2*dim*dim+1 || hess != hess.transpose() ){
+		std::cerr << "Finite hessian from values error: " << err << " with " << vp.n_value << " values" << std::endl;
+		success = false;
+	}
+
+	// Sparse hessian, 2 gradients per color (3 for tridiagonal)
+	sp.fd_hessian = true;
+	Eigen::SparseMatrix<double> sparse_hess;
+	sp.sparse_hessian(x, sparse_hess);
+	err = (sparse_hess-sp.A).norm() / sp.A.norm();
+	if( err > 1e-6 || sp.m_fd.n_colors() != 3 ){
+		std::cerr << "Finite sparse hessian error: " << err << " with " << sp.m_fd.n_colors() << " colors" << std::endl;
+		success = false;
+	}
+
+	// Hessian-vector product
+	VecX v = VecX::Random(dim), Hv;
+	sp.hessian_vec(x, v, Hv);
+	err = (Hv - sp.A*v).norm() / (sp.A*v).norm();
+	if( err > 1e-6 ){
+		std::cerr << "Finite hessian-vector product error: " << err << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "Finite differences: Success" << std::endl; }
+	return success;
+}
+
+
+// Compare auto-diff derivatives of Rosenbrock to the analytic ones
+bool test_autodiff(){
+	std::cout << "\nTest auto-diff:" << std::endl;
+	bool success = true;
+	ADRosenbrock rb;
+	Eigen::Vector2d x(-0.3, 0.7), v(0.4, -1.1);
+	double a = 1.0 - x[0];
+	double b = x[1] - x[0]*x[0];
+	Eigen::Vector2d grad_true( -2.0*a - 400.0*x[0]*b, 200.0*b );
+	Eigen::Matrix2d hess_true;
+	hess_true << 2.0 + 1200.0*x[0]*x[0] - 400.0*x[1], -400.0*x[0],
+		-400.0*x[0], 200.0;
+
+	Eigen::Vector2d grad, Hv;
+	Eigen::Matrix2d hess;
+	double fx = rb.gradient(x, grad);
+	rb.hessian(x, hess);
+	rb.hessian_vec(x, v, Hv);
+	double err = std::max( (grad-grad_true).norm(), std::abs(fx - rb.value(x)) );
+	err = std::max( err, (hess-hess_true).norm() );
+	err = std::max( err, (Hv-hess_true*v).norm() );
+	if( err > 1e-12 ){
+		std::cerr << "Auto-diff derivative error: " << err << std::endl;
+		success = false;
+	}
+
+	Newton<double,2> solver;
+	Eigen::Vector2d x_min = Eigen::Vector2d::Zero();
+	solver.minimize(rb, x_min);
+	if( (x_min - Eigen::Vector2d(1,1)).norm() > 1e-8 ){
+		std::cerr << "Auto-diff failed to minimize: " << x_min.transpose() << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "Auto-diff: Success" << std::endl; }
+	return success;
+}
+
+
+// Compare reverse-mode gradients to analytic and finite difference ones,
+// recorded and replayed
+bool test_reversediff(){
+	std::cout << "\nTest reverse-diff:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 1000;
+
+	RDRosenbrock rb;
+	VecX x = VecX::Random(dim);
+	VecX grad(dim), grad_true(dim);
+	double err = 0;
+	for( int replay=0; replay<2; ++replay ){
+		rb.m_replay = replay;
+		rb.gradient(x, grad);
+		int capacity = rb.m_tape.capacity();
+		for( int i=0; i<3; ++i ){
+			x = VecX::Random(dim);
+			double fx = rb.gradient(x, grad);
+			rb.analytic_gradient(x, grad_true);
+			err = std::max( err, (grad-grad_true).norm() );
+			err = std::max( err, std::abs(fx - rb.value(x)) );
+		}
+		if( rb.m_tape.capacity() != capacity ){
+			std::cerr << "Reverse-diff tape reallocated (replay " << replay << ")" << std::endl;
+			success = false;
+		}
+	}
+
+	RDOps ops;
+	Eigen::Vector2d x2(0.3, -0.8), g2, g2_fd;
+	ops.gradient(x2, g2);
+	ops.finiteGradient(x2, g2_fd);
+	double err_fd = (g2-g2_fd).norm();
+	if( err > 1e-10 || err_fd > 1e-6 ){
+		std::cerr << "Reverse-diff gradient error: " << err << ", vs finite diff: " << err_fd << std::endl;
+		success = false;
+	}
+
+	LBFGS<double,Eigen::Dynamic> solver;
+	solver.m_settings.max_iters = 1000;
+	rb.m_replay = true;
+	x = VecX::Zero(100);
+	solver.minimize(rb, x);
+	if( (x - VecX::Ones(100)).norm() > 1e-8 ){
+		std::cerr << "Reverse-diff failed to minimize: " << (x - VecX::Ones(100)).norm() << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "Reverse-diff: Success" << std::endl; }
+	return success;
+}
+
+
+// The callback should see every accepted step and be able to stop the solver
+bool test_callback( std::vector<MinPtrD> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest callback:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	int dim = 16;
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+		bool curr_success = true;
+
+		QuadProblem qp(dim);
+		VecX x = VecX::Zero(dim);
+		VecX x_prev = x;
+		int n_calls = 0;
+		int last_iter = -1;
+		solvers[i]->m_settings.max_iters = 1000;
+		solvers[i]->m_callback = [&]( const IterationInfo<double,Eigen::Dynamic> &info ){
+			if( info.iter <= last_iter ){ curr_success = false; }
+			if( std::abs( info.fx - qp.value(info.x) ) > 1e-8 ){ curr_success = false; }
+			if( ( info.step - (info.x - x_prev) ).norm() > 1e-8 ){ curr_success = false; }
+			if( ( info.grad - (qp.A*info.x - qp.b) ).norm() > 1e-8 ){ curr_success = false; }
+			last_iter = info.iter;
+			x_prev = info.x;
+			return ++n_calls < 3;
+		};
+		solvers[i]->minimize( qp, x );
+		solvers[i]->m_callback = nullptr;
+		const SolveReport &report = solvers[i]->m_report;
+
+		if( !curr_success ){
+			std::cerr << "(" << names[i] << ") Callback received a wrong iterate" << std::endl;
+		}
+		if( report.termination == Termination::Callback ){
+			if( n_calls != 3 ){
+				std::cerr << "(" << names[i] << ") Callback stopped after " << n_calls << " calls, expected 3" << std::endl;
+				curr_success = false;
+			}
+		}
+		else if( report.termination != Termination::Converged ){
+			std::cerr << "(" << names[i] << ") Bad termination: " << termination_string(report.termination) << std::endl;
+			curr_success = false;
+		}
+		if( (x - x_prev).norm() > 0 ){
+			std::cerr << "(" << names[i] << ") Callback was not given the final iterate" << std::endl;
+			curr_success = false;
+		}
+
+		if( curr_success ){ std::cout << "(" << names[i] << ") Callback: Success" << std::endl; }
+		else{ success = false; }
+	}
+
+	return success;
+}
+
+
+// A slow problem should stop at the deadline, returning an iterate no worse than the start
+bool test_deadline( std::vector<MinPtr2> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest deadline:" << std::endl;
+	bool success = true;
+	const double max_time = 0.02;
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+		bool curr_success = true;
+
+		SlowRosenbrock rb(5e-4);
+		Eigen::Vector2d x(-1.2, 1);
+		double fx0 = rb.Rosenbrock::value(x);
+		solvers[i]->m_settings.max_iters = 100000;
+		solvers[i]->m_settings.max_time = max_time;
+		auto t0 = std::chrono::steady_clock::now();
+		solvers[i]->minimize( rb, x );
+		double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+		solvers[i]->m_settings.max_time = 0;
+		const SolveReport &report = solvers[i]->m_report;
+
+		if( report.termination != Termination::Deadline ){
+			std::cerr << "(" << names[i] << ") Bad termination: " << termination_string(report.termination) << std::endl;
+			curr_success = false;
+		}
+		if( elapsed > 5*max_time ){
+			std::cerr << "(" << names[i] << ") Deadline of " << max_time << "s took " << elapsed << "s" << std::endl;
+			curr_success = false;
+		}
+		if( !( rb.Rosenbrock::value(x) <= fx0 ) ){
+			std::cerr << "(" << names[i] << ") Deadline returned a worse iterate" << std::endl;
+			curr_success = false;
+		}
+
+		if( curr_success ){ std::cout << "(" << names[i] << ") Deadline: Success" << std::endl; }
+		else{ success = false; }
+	}
+
+	return success;
+}
+
+
+// Box constrained problems, the projected gradient should vanish at the solution.
+// Other solvers ignore the bounds.
+bool test_bounds( std::vector<std::string> &names ){
+
+	std::cout << "\nTest bounds:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	if( std::find( names.begin(), names.end(), "lbfgsb" ) == names.end() ){ return success; }
+
+	int dims[3] = { 2, 16, 64 };
+	for( int d=0; d<3; ++d ){
+		int dim = dims[d];
+		BoxQuadProblem qp(dim, 0.1);
+		qp.tol = 1e-8;
+		LBFGSB<double,Eigen::Dynamic> solver;
+		solver.m_settings.max_iters = 1000;
+		solver.m_settings.verbose = 1;
+		VecX x = VecX::Ones(dim); // outside the box
+		solver.minimize( qp, x );
+
+		VecX grad = qp.A*x - qp.b;
+		VecX pg = x - (x - grad).cwiseMax(qp.lower).cwiseMin(qp.upper);
+		int n_active = ( x.array() <= qp.lower.array() || x.array() >= qp.upper.array() ).count();
+		if( solver.m_report.termination != Termination::Converged ){
+			std::cerr << "(lbfgsb) Bad termination: " << termination_string(solver.m_report.termination) << std::endl;
+			success = false;
+		}
+		if( ( x.array() < qp.lower.array() ).any() || ( x.array() > qp.upper.array() ).any() ){
+			std::cerr << "(lbfgsb) x is outside the box" << std::endl;
+			success = false;
+		}
+		if( pg.norm() > 1e-6 ){
+			std::cerr << "(lbfgsb) Failed to minimize box quad (" << dim << "): |pg| = " << pg.norm() << std::endl;
+			success = false;
+		}
+		if( n_active == 0 ){
+			std::cerr << "(lbfgsb) No active bounds, test problem is unconstrained" << std::endl;
+			success = false;
+		}
+	}
+
+	BoxRosenbrock rb;
+	LBFGSB<double,2> solver2;
+	solver2.m_settings.max_iters = 1000;
+	Eigen::Vector2d x2(-1.2, 1);
+	solver2.minimize( rb, x2 );
+	double rn = (x2 - Eigen::Vector2d(0.5,0.25)).norm();
+	if( rn > 1e-6 ){
+		std::cerr << "(lbfgsb) Failed to minimize box Rosenbrock: x = " << x2.transpose() << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "(lbfgsb) Bounds: Success" << std::endl; }
+	return success;
+}
+
+
+// ParallelBacktracking should give the same result as Backtracking,
+// with every concurrent trial step counted in the report
+template<typename Serial, typename Parallel, typename P, typename VecX>
+bool test_parallel_ls_solver( const std::string &name, P &problem, const VecX &x0 ){
+	bool success = true;
+	Serial s_serial;
+	s_serial.m_settings.max_iters = 1000;
+	VecX x_serial = x0;
+	int iters_serial = s_serial.minimize( problem, x_serial );
+
+	const int threads[3] = { 1, 3, 8 };
+	for( int t=0; t<3; ++t ){
+		Parallel s_parallel;
+		s_parallel.m_settings.max_iters = 1000;
+		s_parallel.m_settings.ls_threads = threads[t];
+		VecX x_parallel = x0;
+		int iters_parallel = s_parallel.minimize( problem, x_parallel );
+		const SolveReport &r = s_parallel.m_report;
+		if( iters_parallel != iters_serial || x_parallel != x_serial ){
+			std::cerr << "(" << name << ") ParallelBacktracking (" << threads[t] << " threads): " <<
+				iters_parallel << " iters, Backtracking: " << iters_serial << std::endl;
+			success = false;
+		}
+		if( MCL_SOLVE_REPORT && r.value_calls != r.ls_iters ){
+			std::cerr << "(" << name << ") ParallelBacktracking value calls: " << r.value_calls <<
+				", trial steps: " << r.ls_iters << std::endl;
+			success = false;
+		}
+	}
+	return success;
+}
+
+bool test_parallel_ls( std::vector<std::string> &names ){
+	std::cout << "\nTest parallel line search:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	RosenbrockT<double> rb;
+	QuadT<double> qp(64); // not QuadProblem, its value is not thread safe
+	const Eigen::Vector2d x2(-1.2, 1);
+	const VecX x = VecX::Zero(64);
+	for( size_t i=0; i<names.size(); ++i ){
+		bool curr_success = true;
+		if( names[i] == "lbfgs" ){
+			curr_success &= test_parallel_ls_solver< LBFGS<double,2,8,Backtracking>, LBFGS<double,2,8,ParallelBacktracking> >( names[i], rb, x2 );
+			curr_success &= test_parallel_ls_solver< LBFGS<double,Eigen::Dynamic,8,Backtracking>,
+				LBFGS<double,Eigen::Dynamic,8,ParallelBacktracking> >( names[i], qp, x );
+		}
+		else if( names[i] == "cg" ){
+			curr_success &= test_parallel_ls_solver< NonLinearCG<double,2,Backtracking>, NonLinearCG<double,2,ParallelBacktracking> >( names[i], rb, x2 );
+			curr_success &= test_parallel_ls_solver< NonLinearCG<double,Eigen::Dynamic,Backtracking>,
+				NonLinearCG<double,Eigen::Dynamic,ParallelBacktracking> >( names[i], qp, x );
+		}
+		else { continue; }
+		if( curr_success ){ std::cout << "(" << names[i] << ") Parallel line search: Success" << std::endl; }
+		success &= curr_success;
+	}
+
+	// With the default ls_threads, solvers run by ParallelSolve evaluate
+	// the trial steps serially instead of starting a pool each
+	if( std::find( names.begin(), names.end(), "lbfgs" ) != names.end() ){
+		bool curr_success = true;
+		std::vector< std::shared_ptr< QuadT<double> > > problems;
+		std::vector<VecX> xs;
+		std::vector< ParallelSolve<double,Eigen::Dynamic>::Task > tasks;
+		for( int j=0; j<8; ++j ){
+			problems.emplace_back( std::make_shared< QuadT<double> >( 16 ) );
+			xs.emplace_back( VecX::Zero(16) );
+		}
+		for( int j=0; j<8; ++j ){ tasks.emplace_back( problems[j].get(), &xs[j] ); }
+		LBFGS<double,Eigen::Dynamic,8,ParallelBacktracking> solver;
+		solver.m_settings.max_iters = 1000;
+		ParallelSolve<double,Eigen::Dynamic> par;
+		par.m_settings.threads = 3;
+		int n_converged = par.solve( solver, tasks );
+		LBFGS<double,Eigen::Dynamic,8,Backtracking> serial;
+		serial.m_settings.max_iters = 1000;
+		for( int j=0; j<8; ++j ){
+			VecX x_serial = VecX::Zero(16);
+			serial.minimize( *problems[j], x_serial );
+			if( par.m_reports[j].ls_iters != serial.m_report.ls_iters || x_serial != xs[j] ){
+				std::cerr << "(lbfgs) ParallelBacktracking in ParallelSolve: " << par.m_reports[j].ls_iters <<
+					" trial steps, Backtracking: " << serial.m_report.ls_iters << std::endl;
+				curr_success = false;
+			}
+		}
+		if( n_converged != 8 ){
+			std::cerr << "(lbfgs) ParallelBacktracking in ParallelSolve: " << n_converged << " of 8 converged" << std::endl;
+			curr_success = false;
+		}
+		if( curr_success ){ std::cout << "(lbfgs) Parallel line search in ParallelSolve: Success" << std::endl; }
+		success &= curr_success;
+	}
+	return success;
+}
+
+
+// HagerZhang line search with CG and L-BFGS on Rosenbrock and a quadratic.
+// It should take no more gradients than MoreThuente (within 10%), and converge
+// on the quadratic where the others lose precision near the minimum.
+template<typename Solver2, typename SolverD>
+bool test_hagerzhang_solver( const std::string &name ){
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+
+	int gradients[2] = { 0, 0 };
+	const LSMethod methods[2] = { LSMethod::MoreThuente, LSMethod::HagerZhang };
+	for( int i=0; i<2; ++i ){
+		RosenbrockT<double> rb;
+		Solver2 s2;
+		s2.m_settings.ls_method = methods[i];
+		s2.m_settings.max_iters = 1000;
+		Eigen::Vector2d x2(-1.2, 1);
+		s2.minimize( rb, x2 );
+		gradients[i] = s2.m_report.gradient_calls;
+		if( i==1 && (s2.m_report.termination != Termination::Converged || (x2 - Eigen::Vector2d(1,1)).norm() > 1e-4) ){
+			std::cerr << "(" << name << ") HagerZhang failed to minimize Rosenbrock: x = " << x2.transpose() << std::endl;
+			success = false;
+		}
+	}
+	if( gradients[1] > gradients[0] + gradients[0]/10 ){
+		std::cerr << "(" << name << ") HagerZhang took more gradients than MoreThuente: " <<
+			gradients[1] << " vs " << gradients[0] << std::endl;
+		success = false;
+	}
+
+	QuadProblem qp(64);
+	qp.tol = 1e-8;
+	SolverD sd;
+	sd.m_settings.ls_method = LSMethod::HagerZhang;
+	sd.m_settings.max_iters = 1000;
+	sd.m_settings.verbose = 1;
+	VecX x = VecX::Zero(64);
+	sd.minimize( qp, x );
+	if( sd.m_report.termination != Termination::Converged ){
+		std::cerr << "(" << name << ") HagerZhang failed to minimize quad: " << termination_string(sd.m_report.termination) << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "(" << name << ") HagerZhang: Success" << std::endl; }
+	return success;
+}
+
+bool test_hagerzhang( std::vector<std::string> &names ){
+	std::cout << "\nTest HagerZhang line search:" << std::endl;
+	bool success = true;
+	for( size_t i=0; i<names.size(); ++i ){
+		if( names[i] == "lbfgs" ){ success &= test_hagerzhang_solver< LBFGS<double,2>, LBFGS<double,Eigen::Dynamic> >( names[i] ); }
+		if( names[i] == "cg" ){ success &= test_hagerzhang_solver< NonLinearCG<double,2>, NonLinearCG<double,Eigen::Dynamic> >( names[i] ); }
+	}
+	return success;
+}
+
+
+// Every CGMethod on Rosenbrock and a poorly scaled quadratic,
+// with and without a diagonal preconditioner
+bool test_cg( std::vector<std::string> &names ){
+
+	std::cout << "\nTest cg methods:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	if( std::find( names.begin(), names.end(), "cg" ) == names.end() ){ return success; }
+
+	const CGMethod methods[] = { CGMethod::FletcherReeves, CGMethod::PolakRibierePlus,
+		CGMethod::HestenesStiefel, CGMethod::DaiYuan, CGMethod::HagerZhang };
+	const char* method_names[] = { "fletcher-reeves", "polak-ribiere+", "hestenes-stiefel", "dai-yuan", "hager-zhang" };
+	ScaledQuadProblem qp(64);
+	qp.tol = 1e-6;
+	for( int i=0; i<5; ++i ){
+
+		RosenbrockT<double> rb;
+		NonLinearCG<double,2> solver2;
+		solver2.m_settings.cg_method = methods[i];
+		solver2.m_settings.max_iters = 10000;
+		Eigen::Vector2d x2 = Eigen::Vector2d::Zero();
+		solver2.minimize( rb, x2 );
+		double rn = (x2 - Eigen::Vector2d(1,1)).norm();
+		if( rn > 1e-4 ){
+			std::cerr << "(cg " << method_names[i] << ") Failed to minimize Rosenbrock: x = " << x2.transpose() << std::endl;
+			success = false;
+		}
+
+		int iters[2] = { 0, 0 };
+		for( int pc=0; pc<2; ++pc ){
+			qp.use_precond = pc==1;
+			NonLinearCG<double,Eigen::Dynamic> solver;
+			solver.m_settings.cg_method = methods[i];
+			solver.m_settings.ls_method = LSMethod::HagerZhang;
+			solver.m_settings.max_iters = 100000;
+			VecX x = VecX::Zero(64);
+			solver.minimize( qp, x );
+			iters[pc] = solver.m_report.iters;
+			if( solver.m_report.termination != Termination::Converged ){
+				std::cerr << "(cg " << method_names[i] << ") Failed to minimize scaled quad: " <<
+					termination_string(solver.m_report.termination) << ", preconditioned = " << pc << std::endl;
+				success = false;
+			}
+		}
+		if( iters[1] >= iters[0] ){
+			std::cerr << "(cg " << method_names[i] << ") Preconditioner did not reduce iterations: " <<
+				iters[1] << " vs " << iters[0] << std::endl;
+			success = false;
+		}
+		std::cout << "(cg " << method_names[i] << ") iters: " << iters[0] << ", preconditioned: " << iters[1] << std::endl;
+	}
+
+	if( success ){ std::cout << "(cg) Methods: Success" << std::endl; }
+	return success;
+}
+
+
+// Nonmonotone line search on a narrow chained Rosenbrock valley. With eta = 0
+// the reference is f(x) and the iterates should match BacktrackingCubic. Both the
+// average and the window reference should converge, and if fewer_values, take
+// fewer evaluations than BacktrackingCubic (Newton, whose full steps leave the valley).
+template<typename Monotone, typename Nonmonotone>
+bool test_nonmonotone_solver( const std::string &name, int max_iters, bool fewer_values ){
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	bool success = true;
+	ChainedRosenbrock rb(100);
+	VecX x0;
+	rb.init(16, x0);
+
+	Monotone s_mono;
+	s_mono.m_settings.max_iters = max_iters;
+	VecX x_mono = x0;
+	int iters_mono = s_mono.minimize( rb, x_mono );
+
+	Nonmonotone s_eta0;
+	s_eta0.m_settings.max_iters = max_iters;
+	s_eta0.m_settings.nm.eta = 0;
+	VecX x = x0;
+	int iters = s_eta0.minimize( rb, x );
+	if( iters != iters_mono || x != x_mono ){
+		std::cerr << "(" << name << ") Nonmonotone with eta = 0: " << iters <<
+			" iters, BacktrackingCubic: " << iters_mono << std::endl;
+		success = false;
+	}
+
+	const int windows[2] = { 0, 10 };
+	for( int i=0; i<2; ++i ){
+		Nonmonotone s;
+		s.m_settings.max_iters = max_iters;
+		s.m_settings.nm.window = windows[i];
+		x = x0;
+		s.minimize( rb, x );
+		const SolveReport &r = s.m_report;
+		if( r.termination != Termination::Converged ){
+			std::cerr << "(" << name << ") Nonmonotone (window " << windows[i] << "): " <<
+				termination_string(r.termination) << std::endl;
+			success = false;
+		}
+		if( MCL_SOLVE_REPORT && fewer_values && r.value_calls >= s_mono.m_report.value_calls ){
+			std::cerr << "(" << name << ") Nonmonotone (window " << windows[i] << ") value calls: " <<
+				r.value_calls << ", BacktrackingCubic: " << s_mono.m_report.value_calls << std::endl;
+			success = false;
+		}
+	}
+
+	// Trial steps outside the domain of f (value is inf) should be shortened
+	// rather than interpolated, for both line searches.
+	LogBarrier lb(100);
+	lb.init(x0);
+	VecX xstar = lb.c.cwiseInverse();
+	x = x0;
+	s_mono.minimize( lb, x );
+	if( s_mono.m_report.termination != Termination::Converged || (x - xstar).norm() > 1e-5 ){
+		std::cerr << "(" << name << ") BacktrackingCubic on log barrier: " <<
+			termination_string(s_mono.m_report.termination) << std::endl;
+		success = false;
+	}
+	Nonmonotone s_lb;
+	s_lb.m_settings.max_iters = max_iters;
+	x = x0;
+	s_lb.minimize( lb, x );
+	if( s_lb.m_report.termination != Termination::Converged || (x - xstar).norm() > 1e-5 ){
+		std::cerr << "(" << name << ") Nonmonotone on log barrier: " <<
+			termination_string(s_lb.m_report.termination) << std::endl;
+		success = false;
+	}
+	return success;
+}
+
+bool test_nonmonotone( std::vector<std::string> &names ){
+	std::cout << "\nTest nonmonotone line search:" << std::endl;
+	bool success = true;
+	for( size_t i=0; i<names.size(); ++i ){
+		bool curr_success = true;
+		if( names[i] == "lbfgs" ){
+			curr_success &= test_nonmonotone_solver< LBFGS<double,Eigen::Dynamic,8,BacktrackingCubic>,
+				LBFGS<double,Eigen::Dynamic,8,NonmonotoneBacktracking> >( names[i], 1000, false );
+		}
+		else if( names[i] == "cg" ){
+			curr_success &= test_nonmonotone_solver< NonLinearCG<double,Eigen::Dynamic,BacktrackingCubic>,
+				NonLinearCG<double,Eigen::Dynamic,NonmonotoneBacktracking> >( names[i], 10000, false );
+		}
+		else if( names[i] == "newton" ){
+			curr_success &= test_nonmonotone_solver< Newton<double,Eigen::Dynamic,BacktrackingCubic>,
+				Newton<double,Eigen::Dynamic,NonmonotoneBacktracking> >( names[i], 100, true );
+		}
+		else { continue; }
+		if( curr_success ){ std::cout << "(" << names[i] << ") Nonmonotone line search: Success" << std::endl; }
+		success &= curr_success;
+	}
+	return success;
+}
+
+
+// Solve a quadratic and Rosenbrock in single precision,
+// the results should be as accurate as float allows
+template<typename SolverD, typename Solver2>
+bool test_float_solver( const std::string &name ){
+	typedef Eigen::Matrix<float,Eigen::Dynamic,1> VecXf;
+	bool success = true;
+
+	QuadT<float> qp(16);
+	SolverD sd;
+	if( name == "steihaug" ){ sd.m_settings.tr_method = TRMethod::SteihaugCG; }
+	sd.m_settings.verbose = 1;
+	VecXf x = VecXf::Zero(16);
+	sd.minimize(qp, x);
+	float rn = (qp.A*x - qp.b).norm() / qp.b.norm();
+	if( !(rn < 1e-3f) ){
+		std::cerr << "(" << name << ") Float failed to minimize: |Ax-b|/|b| = " << rn << std::endl;
+		success = false;
+	}
+
+	RosenbrockT<float> rb;
+	Solver2 s2;
+	if( name == "steihaug" ){ s2.m_settings.tr_method = TRMethod::SteihaugCG; }
+	s2.m_settings.max_iters = 1000;
+	Eigen::Vector2f x2 = Eigen::Vector2f::Zero();
+	s2.minimize(rb, x2);
+	rn = (x2 - Eigen::Vector2f(1,1)).norm();
+	if( !(rn < 1e-2f) ){
+		std::cerr << "(" << name << ") Float failed to minimize: Rosenbrock = " << rn << std::endl;
+		success = false;
+	}
+
+	if( success ){ std::cout << "(" << name << ") Float: Success" << std::endl; }
+	return success;
+}
+
+bool test_float( std::vector<std::string> &names ){
+	std::cout << "\nTest float:" << std::endl;
+	bool success = true;
+	for( size_t i=0; i<names.size(); ++i ){
+		if( names[i] == "lbfgs" ){ success &= test_float_solver< LBFGS<float,Eigen::Dynamic>, LBFGS<float,2> >( names[i] ); }
+		if( names[i] == "lbfgsb" ){ success &= test_float_solver< LBFGSB<float,Eigen::Dynamic>, LBFGSB<float,2> >( names[i] ); }
+		if( names[i] == "cg" ){ success &= test_float_solver< NonLinearCG<float,Eigen::Dynamic>, NonLinearCG<float,2> >( names[i] ); }
+		if( names[i] == "newton" ){ success &= test_float_solver< Newton<float,Eigen::Dynamic>, Newton<float,2> >( names[i] ); }
+		if( names[i] == "newtoncg" ){ success &= test_float_solver< NewtonCG<float,Eigen::Dynamic>, NewtonCG<float,2> >( names[i] ); }
+		if( names[i] == "trustregion" || names[i] == "steihaug" ){
+			success &= test_float_solver< TrustRegion<float,Eigen::Dynamic>, TrustRegion<float,2> >( names[i] );
+		}
+	}
+
+	// Float energy with a double solver (see MixedProblem.hpp)
+	if( std::find( names.begin(), names.end(), "lbfgs" ) != names.end() ){
+		typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+		QuadT<float> qp(16);
+		MixedProblem<double,Eigen::Dynamic> mixed(qp);
+		LBFGS<double,Eigen::Dynamic> solver;
+		VecX x = VecX::Zero(16);
+		solver.minimize(mixed, x);
+		float rn = (qp.A*x.cast<float>() - qp.b).norm() / qp.b.norm();
+		if( !(rn < 1e-3f) ){
+			std::cerr << "(lbfgs) Mixed precision failed to minimize: |Ax-b|/|b| = " << rn << std::endl;
+			success = false;
+		}
+		else{ std::cout << "(lbfgs) Mixed precision: Success" << std::endl; }
+	}
+
+	// The float problem's own Newton solve should be used
+	const char *newton_names[2] = { "newton", "trustregion" };
+	for( int i=0; i<2; ++i ){
+		if( std::find( names.begin(), names.end(), newton_names[i] ) == names.end() ){ continue; }
+		typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+		LLTQuadT<float> qp(16);
+		MixedProblem<double,Eigen::Dynamic> mixed(qp);
+		std::unique_ptr< Minimizer<double,Eigen::Dynamic> > solver;
+		if( i == 0 ){ solver.reset( new Newton<double,Eigen::Dynamic>() ); }
+		else{ solver.reset( new TrustRegion<double,Eigen::Dynamic>() ); }
+		VecX x = VecX::Zero(16);
+		solver->minimize(mixed, x);
+		float rn = (qp.A*x.cast<float>() - qp.b).norm() / qp.b.norm();
+		if( !(rn < 1e-3f) || qp.n_solve_hessian == 0 ){
+			std::cerr << "(" << newton_names[i] << ") Mixed precision: |Ax-b|/|b| = " << rn <<
+				", " << qp.n_solve_hessian << " calls to the float solve_hessian" << std::endl;
+			success = false;
+		}
+		else{ std::cout << "(" << newton_names[i] << ") Mixed precision: Success" << std::endl; }
+	}
+
+	return success;
+}
+
+
+// Solve many problems in parallel, the results should match serial solves
+bool test_parallel( std::vector<MinPtrD> &solvers, std::vector<std::string> &names ){
+
+	std::cout << "\nTest parallel:" << std::endl;
+	typedef Eigen::Matrix<double,Eigen::Dynamic,1> VecX;
+	typedef ParallelSolve<double,Eigen::Dynamic>::Task Task;
+	bool success = true;
+	int n = 24;
+
+	int n_solvers = solvers.size();
+	for( int i=0; i<n_solvers; ++i ){
+		bool curr_success = true;
+		solvers[i]->m_settings.max_iters = 1000;
+		solvers[i]->m_settings.verbose = 0;
+
+		// Problems of different sizes so the iterations vary
+		std::vector< std::shared_ptr<QuadProblem> > problems;
+		std::vector<VecX> x_par, x_ser;
+		std::vector<Task> tasks;
+		for( int j=0; j<n; ++j ){
+			problems.emplace_back( std::make_shared<QuadProblem>( 2 + (j*7) % 30 ) );
+			problems.back()->tol = 1e-6;
+			x_par.emplace_back( VecX::Zero( problems.back()->b.rows() ) );
+		}
+		x_ser = x_par;
+		for( int j=0; j<n; ++j ){ tasks.emplace_back( problems[j].get(), &x_par[j] ); }
+
+		ParallelSolve<double,Eigen::Dynamic> par;
+		par.m_settings.threads = 3;
+		int n_converged = par.solve( *solvers[i], tasks );
+
+		int n_converged_ser = 0;
+		for( int j=0; j<n; ++j ){
+			int iters = solvers[i]->minimize( *problems[j], x_ser[j] );
+			n_converged_ser += solvers[i]->m_report.termination == Termination::Converged;
+			if( iters != par.m_iters[j] || x_ser[j] != x_par[j] ){
+				std::cerr << "(" << names[i] << ") Parallel solve " << j << " differs from serial" << std::endl;
+				curr_success = false;
+			}
+			if( par.m_reports[j].iters != solvers[i]->m_report.iters ){
+				std::cerr << "(" << names[i] << ") Parallel report " << j << " differs from serial" << std::endl;
+				curr_success = false;
+			}
+		}
+		if( n_converged != n_converged_ser ){
+			std::cerr << "(" << names[i] << ") " << n_converged << " converged, expected " << n_converged_ser << std::endl;
+			curr_success = false;
+		}
+
+		if( curr_success ){ std::cout << "(" << names[i] << ") Parallel: Success" << std::endl; }
+		else{ success = false; }
+	}
+
+	return success;
+}
+
+
+// Test the batch minimizer against the known minimum of each problem
+bool test_batch(){
+
+	std::cout << "\nTest batch:" << std::endl;
+	typedef BatchMinimizer<double,2,4> BatchMin;
+	bool success = true;
+	int n = 37; // not a multiple of the lanes
+
+	std::vector<BatchMethod> methods = { BatchMethod::LBFGS, BatchMethod::Newton };
+	std::vector<std::string> method_names = { "lbfgs", "newton" };
+	for( size_t i=0; i<methods.size(); ++i ){
+		for( int threads=1; threads<=2; ++threads ){
+			bool curr_success = true;
+
+			BatchRosenbrock<4> problem(n);
+			BatchMin solver;
+			solver.m_settings.method = methods[i];
+			solver.m_settings.threads = threads;
+			solver.m_settings.max_iters = 1000;
+			BatchMin::MatXN X = BatchMin::MatXN::Zero(2,n);
+			int n_converged = solver.minimize( problem, X );
+
+			double max_err = 0;
+			for( int j=0; j<n; ++j ){
+				double a = problem.a(j);
+				max_err = std::max( max_err, (X.col(j) - Eigen::Vector2d(a,a*a)).norm() );
+			}
+			if( n_converged != n || max_err > 1e-6 ){
+				std::cerr << "(" << method_names[i] << ") Batch converged " << n_converged << " of " << n <<
+					", max error " << max_err << std::endl;
+				curr_success = false;
+			}
+
+			// Lanes converge at different iterations
+			if( solver.m_iters.minCoeff() == solver.m_iters.maxCoeff() ){
+				std::cerr << "(" << method_names[i] << ") Batch lanes were not masked" << std::endl;
+				curr_success = false;
+			}
+
+			if( curr_success ){ std::cout << "(" << method_names[i] << ") Batch (" << threads << " threads): Success" << std::endl; }
+			else{ success = false; }
+		}
+
+		// Float with the default finite difference gradient and hessian
+		BatchSphere<float,4> sphere(n);
+		BatchMinimizer<float,2,4> solver_f;
+		solver_f.m_settings.method = methods[i];
+		solver_f.m_settings.max_iters = 1000;
+		BatchMinimizer<float,2,4>::MatXN Xf = BatchMinimizer<float,2,4>::MatXN::Zero(2,n);
+		solver_f.minimize( sphere, Xf );
+		float max_err = 0;
+		for( int j=0; j<n; ++j ){
+			float a = sphere.a(j);
+			max_err = std::max( max_err, (Xf.col(j) - Eigen::Vector2f(a,a)).norm() );
+		}
+		if( !(max_err < 1e-3f) ){
+			std::cerr << "(" << method_names[i] << ") Float batch max error " << max_err << std::endl;
+			success = false;
+		}
+		else{ std::cout << "(" << method_names[i] << ") Float batch: Success" << std::endl; }
+	}
+
 	return success;
 }
 
@@ -179,6 +1401,11 @@ int main(int argc, char *argv[] ){
 		minD.emplace_back( std::make_shared< LBFGS<double,Eigen::Dynamic> >( LBFGS<double,Eigen::Dynamic>() ) );
 		names.emplace_back( "lbfgs" );
 	}
+	if( mode=="lbfgsb" || mode=="all" ){
+		min2.emplace_back( std::make_shared< LBFGSB<double,2> >( LBFGSB<double,2>() ) );
+		minD.emplace_back( std::make_shared< LBFGSB<double,Eigen::Dynamic> >( LBFGSB<double,Eigen::Dynamic>() ) );
+		names.emplace_back( "lbfgsb" );
+	}
 	if( mode=="cg" || mode=="all" ){
 		min2.emplace_back( std::make_shared< NonLinearCG<double,2> >( NonLinearCG<double,2>() ) );
 		minD.emplace_back( std::make_shared< NonLinearCG<double,Eigen::Dynamic> >( NonLinearCG<double,Eigen::Dynamic>() ) );
@@ -189,16 +1416,50 @@ int main(int argc, char *argv[] ){
 		minD.emplace_back( std::make_shared< Newton<double,Eigen::Dynamic> >( Newton<double,Eigen::Dynamic>() ) );
 		names.emplace_back( "newton" );
 	}
+	if( mode=="newtoncg" || mode=="all" ){
+		min2.emplace_back( std::make_shared< NewtonCG<double,2> >( NewtonCG<double,2>() ) );
+		minD.emplace_back( std::make_shared< NewtonCG<double,Eigen::Dynamic> >( NewtonCG<double,Eigen::Dynamic>() ) );
+		names.emplace_back( "newtoncg" );
+	}
 	if( mode=="trustregion" || mode=="all" ){
 		min2.emplace_back( std::make_shared< TrustRegion<double,2> >( TrustRegion<double,2>() ) );
 		minD.emplace_back( std::make_shared< TrustRegion<double,Eigen::Dynamic> >( TrustRegion<double,Eigen::Dynamic>() ) );
 		names.emplace_back( "trustregion" );
 	}
+	if( mode=="steihaug" || mode=="all" ){
+		std::shared_ptr< TrustRegion<double,2> > tr2 = std::make_shared< TrustRegion<double,2> >();
+		std::shared_ptr< TrustRegion<double,Eigen::Dynamic> > trD = std::make_shared< TrustRegion<double,Eigen::Dynamic> >();
+		tr2->m_settings.tr_method = TRMethod::SteihaugCG;
+		trD->m_settings.tr_method = TRMethod::SteihaugCG;
+		min2.emplace_back( tr2 );
+		minD.emplace_back( trD );
+		names.emplace_back( "steihaug" );
+	}
 
 	bool success = true;
 	success &= test_linear( minD, names );
 	success &= test_rb( min2, names );
 	success &= test_zero( minD, names );
+	success &= test_static( names );
+	success &= test_policy( names );
+	success &= test_sparse( minD, names );
+	success &= test_malloc( minD, names );
+	success &= test_warmstart( names );
+	success &= test_evals( minD, names );
+	success &= test_report( minD, names );
+	success &= test_callback( minD, names );
+	success &= test_deadline( min2, names );
+	success &= test_parallel( minD, names );
+	success &= test_bounds( names );
+	success &= test_cg( names );
+	success &= test_hagerzhang( names );
+	success &= test_parallel_ls( names );
+	success &= test_nonmonotone( names );
+	success &= test_float( names );
+	success &= test_finitediff();
+	success &= test_autodiff();
+	success &= test_reversediff();
+	if( mode=="batch" || mode=="all" ){ success &= test_batch(); }
 	if( success ){
 		std::cout << "\nSUCCESS!" << std::endl;
 		return EXIT_SUCCESS;